@@ -155,16 +155,40 @@ float3 BRDF(Light gLights[MaxLights], Material mat,
         Lo += (kD * mat.DiffuseAlbedo / PI + specular) * radiance * NdotL; 
     }
     
+    float3 color = Lo;
+#ifdef IBL
     // ambient lighting (we now use IBL as the ambient term)
     //float3 ambient = float3(0.03) * mat.DiffuseAlbedo * ao;
-    float3 F = fresnelSchlickRoughness(max(dot(normal, view), 0.0f), mat.FresnelR0, mat.Roughness);
+    float NdotV = max(dot(normal, view), 0.0f);
+    float3 F = fresnelSchlickRoughness(NdotV, mat.FresnelR0, mat.Roughness);
     float3 kS = F;
     float3 kD = float3(1.0f, 1.0f, 1.0f) - kS;
     kD *= 1.0 - mat.Metallic;
-    float3 irradiance = gIrradianceMap.Sample(gsamLinearWrap, normal).rgb;
+    float3 irradiance = IrradianceSH(normal);
     float3 diffuse = irradiance * mat.DiffuseAlbedo;
-    float3 ambient = (kD * diffuse); // * ao;
-    float3 color = ambient + Lo;
+
+    // Split-sum specular: the prefiltered sky along the reflection vector
+    // times the environment BRDF.
+    uint width, height, mipCount;
+    gSpecularMap.GetDimensions(0, width, height, mipCount);
+    float3 reflection = reflect(-view, normal);
+    float3 prefiltered = gSpecularMap.SampleLevel(gsamLinearClamp, reflection, mat.Roughness * (mipCount - 1)).rgb;
+    float3 envBRDF = gBrdfLut.SampleLevel(gsamLinearClamp, float2(NdotV, mat.Roughness), 0.0f).rgb;
+    float3 specular = prefiltered * (mat.FresnelR0 * envBRDF.x + envBRDF.y);
+
+    // Energy lost to single scattering comes back as multiple scattering
+    // (Kulla and Conty), lit like a diffuse lobe. A table without the
+    // average albedo in blue leaves it off.
+    float singleAlbedo = envBRDF.x + envBRDF.y;
+    float averageAlbedo = envBRDF.z;
+    float3 averageFresnel = mat.FresnelR0 + (1.0f - mat.FresnelR0) / 21.0f;
+    float3 multiFresnel = averageFresnel * averageFresnel * averageAlbedo /
+        (1.0f - averageFresnel * (1.0f - averageAlbedo));
+    specular += irradiance * (1.0f - singleAlbedo) * multiFresnel;
+
+    float3 ambient = kD * diffuse + specular; // * ao;
+    color += ambient;
+#endif
     return color;
 }
 
@@ -36,7 +36,12 @@ struct MaterialData
 };
 
 TextureCube gCubeMap : register(t0);
-TextureCube gIrradianceMap : register(t1);
+// The sky prefiltered for GGX specular; level m is perceptual roughness
+// m / (levels - 1), see SpecularPrefilter.
+TextureCube gSpecularMap : register(t1);
+// Split-sum environment BRDF by (NdotV, roughness): F0 scale, bias and the
+// average albedo for multiple scattering, see BrdfLut.
+Texture2D gBrdfLut : register(t2);
 
 Texture2D gTextures[4] : register(t1, space1);
 
@@ -76,4 +81,25 @@ cbuffer cbPass : register(b1)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
-};
\ No newline at end of file
+
+    // Diffuse light of the sky as order 2 spherical harmonics, baked on the
+    // CPU by SphericalHarmonics::ProjectIrradiance; w is unused.
+    float4 gIrradianceSH[9];
+};
+
+// Irradiance over pi for a unit normal n, so it scales the diffuse albedo
+// directly. The coefficients already include the basis constants and the
+// cosine convolution.
+float3 IrradianceSH(float3 n)
+{
+    float3 result = gIrradianceSH[0].rgb;
+    result += gIrradianceSH[1].rgb * n.y;
+    result += gIrradianceSH[2].rgb * n.z;
+    result += gIrradianceSH[3].rgb * n.x;
+    result += gIrradianceSH[4].rgb * (n.x * n.y);
+    result += gIrradianceSH[5].rgb * (n.y * n.z);
+    result += gIrradianceSH[6].rgb * (3.0f * n.z * n.z - 1.0f);
+    result += gIrradianceSH[7].rgb * (n.x * n.z);
+    result += gIrradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+    return max(result, 0.0f);
+}
\ No newline at end of file
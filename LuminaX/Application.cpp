@@ -39,7 +39,9 @@ bool Application::Init(HINSTANCE hinstance)
 
 	//d3d12
 	CreateDevice();
+	mGpuAllocator = std::make_unique<GpuHeapAllocator>(md3dDevice.Get(), GpuHeapBlockSize);
 	CreateCommandObjects();
+	mFramePacer.Init(md3dDevice.Get(), mCommandQueue.Get(), mFence.Get());
 	CreateSwapChain();
 	CreateRtvAndDsvDescHeap();
 
@@ -80,12 +82,14 @@ int Application::Run()
 			if (!mPaused)
 			{
 				//CalculateFrameStats();
+				mFramePacer.Throttle();
 				Update();
 				Draw();
 			}
 			else
 			{
-				Sleep(100);
+				// Nothing to render; sleep until the next message arrives.
+				WaitMessage();
 			}
 		}
 	}
@@ -100,6 +104,9 @@ int Application::Run()
 extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 LRESULT Application::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+	if ((msg >= WM_MOUSEFIRST && msg <= WM_MOUSELAST) || (msg >= WM_KEYFIRST && msg <= WM_KEYLAST))
+		mFramePacer.OnInput();
+
 	if (ImGui_ImplWin32_WndProcHandler(hwnd, msg, wParam, lParam))
 		return true;
 
@@ -150,6 +157,10 @@ LRESULT Application::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	case WM_MOUSEMOVE:
 		OnMouseMove(wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
 		return 0;
+
+	case WM_KEYDOWN:
+		OnKeyDown(wParam);
+		return 0;
 	}
 	return DefWindowProc(hwnd, msg, wParam, lParam);
 }
@@ -160,13 +171,7 @@ void Application::FlushCommandQueue()
 
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 
-	if (mFence->GetCompletedValue() < mCurrentFence)
-	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
-		mFence->SetEventOnCompletion(mCurrentFence, eventHandle);
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
-	}
+	mFramePacer.WaitForFence(mCurrentFence);
 }
 
 void Application::OnResize()
@@ -210,10 +215,10 @@ void Application::OnResize()
 	clearVal.DepthStencil.Depth = 1.f;
 	clearVal.DepthStencil.Stencil = (UINT8)0.f;
 
-	auto heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	md3dDevice->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE,
-	                                    &dsDesc, D3D12_RESOURCE_STATE_COMMON, &clearVal,
-	                                    IID_PPV_ARGS((&mDepthStencilBuffer)));
+	// Placed depth buffers have undefined contents until cleared; Draw clears
+	// it every frame before the first depth test.
+	mDepthStencilBuffer = mGpuAllocator->CreateResource(dsDesc, D3D12_HEAP_TYPE_DEFAULT,
+	                                                    D3D12_RESOURCE_STATE_COMMON, &clearVal);
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
 	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
 	dsvDesc.Format = mDepthStencilFormat;
@@ -2,11 +2,16 @@
 #include <dxgi1_4.h>
 #include <wrl.h>
 #include "directx//d3d12.h"
+#include "FramePacer.h"
+#include "GpuHeapAllocator.h"
+#include <memory>
 
 class Application
 {
 public:
 	static constexpr int SwapChainBufferCount = 2;
+	// Size of the heaps placed resources are suballocated from.
+	static constexpr UINT64 GpuHeapBlockSize = 64ull * 1024 * 1024;
 	Application();
 	~Application();
 	static Application* Get();
@@ -24,6 +29,7 @@ protected:
 	virtual void OnMouseDown(WPARAM btnState, int x, int y) { }
 	virtual void OnMouseUp(WPARAM btnState, int x, int y) { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) { }
+	virtual void OnKeyDown(WPARAM key) { }
 
 	void DrawImGui();
 
@@ -46,18 +52,21 @@ protected:
 	HWND mhMainWindow;
 	Microsoft::WRL::ComPtr<IDXGIFactory4> mdxgiFactory;
 	Microsoft::WRL::ComPtr<ID3D12Device>   md3dDevice;
+	// Declared before every GpuResource so that it is destroyed after them.
+	std::unique_ptr<GpuHeapAllocator> mGpuAllocator;
 	Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
 
 	UINT64 mCurrentFence = 0;
 	int mCurrBackBuffer = 0;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> mSwapChainBuffer[SwapChainBufferCount];
-	Microsoft::WRL::ComPtr<ID3D12Resource> mDepthStencilBuffer;
+	GpuResource mDepthStencilBuffer;
 
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mRtvDescHeap;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mDsvDescHeap;
 
 	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	FramePacer mFramePacer;
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
 	Microsoft::WRL::ComPtr<ID3D12CommandAllocator>mCommandListAlloc;
 	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>mCommandList;
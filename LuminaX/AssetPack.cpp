@@ -0,0 +1,418 @@
+#include "AssetPack.h"
+#include "FileUtil.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // LZ4 block format: sequences of a token (literal length << 4 | match
+    // length - MinMatch), the literals, a 16 bit offset and the match. Lengths
+    // of 15 continue in following bytes that are added up until one is < 255.
+    // The last sequence only has literals.
+    constexpr size_t MinMatch = 4;
+    constexpr size_t LastLiterals = 5;      // no match may reach into the last 5 bytes
+    constexpr size_t MatchStartLimit = 12;  // or start in the last 12
+    constexpr size_t MaxOffset = 65535;
+    constexpr uint32_t HashBits = 16;
+
+    // Compressed payloads have to save at least 1/8th of the size.
+    constexpr uint64_t MinSavingShift = 3;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    uint32_t Read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void WriteLength(std::vector<uint8_t>& out, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+            out.push_back(255);
+        out.push_back((uint8_t)length);
+    }
+
+    void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength,
+        size_t offset, size_t matchLength)
+    {
+        const size_t matchCode = matchLength - MinMatch;
+        out.push_back((uint8_t)((std::min<size_t>(literalLength, 15) << 4) |
+            (matchLength != 0 ? std::min<size_t>(matchCode, 15) : 0)));
+        if (literalLength >= 15)
+            WriteLength(out, literalLength - 15);
+        out.insert(out.end(), literals, literals + literalLength);
+
+        if (matchLength == 0)
+            return;
+        out.push_back((uint8_t)offset);
+        out.push_back((uint8_t)(offset >> 8));
+        if (matchCode >= 15)
+            WriteLength(out, matchCode - 15);
+    }
+
+    // Greedy, single candidate per hash: fast enough to pack at build time,
+    // and the format decodes at memory speed.
+    std::vector<uint8_t> Compress(const uint8_t* source, size_t size)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(size + size / 255 + 16);
+
+        size_t anchor = 0;
+        if (size > MatchStartLimit)
+        {
+            std::vector<uint32_t> table(size_t(1) << HashBits, 0);
+            const size_t matchEnd = size - LastLiterals;
+            const size_t searchEnd = size - MatchStartLimit;
+
+            size_t position = 0;
+            while (position < searchEnd)
+            {
+                const uint32_t sequence = Read32(source + position);
+                const uint32_t slot = (sequence * 2654435761u) >> (32 - HashBits);
+                const size_t candidate = table[slot];
+                table[slot] = (uint32_t)position;
+
+                if (candidate >= position || position - candidate > MaxOffset ||
+                    Read32(source + candidate) != sequence)
+                {
+                    ++position;
+                    continue;
+                }
+
+                size_t length = MinMatch;
+                while (position + length < matchEnd && source[candidate + length] == source[position + length])
+                    ++length;
+
+                WriteSequence(out, source + anchor, position - anchor, position - candidate, length);
+                position += length;
+                anchor = position;
+            }
+        }
+
+        WriteSequence(out, source + anchor, size - anchor, 0, 0);
+        return out;
+    }
+
+    bool ReadLength(const uint8_t* source, size_t size, size_t& in, size_t& length)
+    {
+        uint8_t value;
+        do
+        {
+            if (in >= size)
+                return false;
+            value = source[in++];
+            length += value;
+        } while (value == 255);
+        return true;
+    }
+
+    bool Decompress(const uint8_t* source, size_t size, uint8_t* dest, size_t destSize)
+    {
+        size_t in = 0;
+        size_t out = 0;
+        while (in < size)
+        {
+            const uint8_t token = source[in++];
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !ReadLength(source, size, in, literalLength))
+                return false;
+            if (literalLength > size - in || literalLength > destSize - out)
+                return false;
+            memcpy(dest + out, source + in, literalLength);
+            in += literalLength;
+            out += literalLength;
+
+            if (in == size)
+                break;
+
+            if (size - in < 2)
+                return false;
+            const size_t offset = source[in] | (size_t(source[in + 1]) << 8);
+            in += 2;
+            if (offset == 0 || offset > out)
+                return false;
+
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(source, size, in, matchLength))
+                return false;
+            matchLength += MinMatch;
+            if (matchLength > destSize - out)
+                return false;
+
+            // Matches may overlap their own output, so copy byte by byte.
+            const uint8_t* match = dest + out - offset;
+            for (size_t i = 0; i < matchLength; ++i)
+                dest[out + i] = match[i];
+            out += matchLength;
+        }
+        return out == destSize;
+    }
+
+    bool EntryFits(const AssetPackEntry& entry, const AssetPackHeader& header)
+    {
+        return entry.Offset % AssetPackHeader::PayloadAlignment == 0 &&
+            entry.Offset <= header.FileSize && entry.StoredSize <= header.FileSize - entry.Offset &&
+            uint64_t(entry.NameOffset) + entry.NameLength <= header.NameSize &&
+            ((entry.Flags & AssetPackEntry::Compressed) != 0 || entry.StoredSize == entry.Size);
+    }
+}
+
+bool AssetPack::Open(const std::wstring& fileName)
+{
+    Close();
+
+    if (!mFile.Open(fileName))
+        return false;
+
+    if (mFile.Size() < sizeof(AssetPackHeader))
+    {
+        Close();
+        return false;
+    }
+
+    auto header = reinterpret_cast<const AssetPackHeader*>(mFile.Data());
+    bool valid = header->Magic == AssetPackHeader::MagicValue &&
+        header->Version == AssetPackHeader::CurrentVersion &&
+        header->HeaderSize == sizeof(AssetPackHeader) &&
+        header->FileSize == mFile.Size() &&
+        header->EntryOffset % alignof(AssetPackEntry) == 0 &&
+        header->EntryOffset <= header->FileSize &&
+        header->EntryCount <= (header->FileSize - header->EntryOffset) / sizeof(AssetPackEntry) &&
+        header->NameOffset <= header->FileSize &&
+        header->NameSize <= header->FileSize - header->NameOffset;
+
+    if (valid)
+    {
+        auto entries = reinterpret_cast<const AssetPackEntry*>(mFile.Data() + header->EntryOffset);
+        for (uint32_t i = 0; i < header->EntryCount && valid; ++i)
+            valid = EntryFits(entries[i], *header) && (i == 0 || entries[i - 1].PathHash <= entries[i].PathHash);
+    }
+
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    std::error_code error;
+    mWriteTime = std::filesystem::last_write_time(fileName, error);
+    mHeader = header;
+    return true;
+}
+
+void AssetPack::Close()
+{
+    mHeader = nullptr;
+    mFile.Close();
+}
+
+bool AssetPack::IsOpen() const
+{
+    return mHeader != nullptr;
+}
+
+std::span<const AssetPackEntry> AssetPack::Entries() const
+{
+    if (mHeader == nullptr)
+        return {};
+    return { reinterpret_cast<const AssetPackEntry*>(mFile.Data() + mHeader->EntryOffset), mHeader->EntryCount };
+}
+
+std::string_view AssetPack::Name(const AssetPackEntry& entry) const
+{
+    if (mHeader == nullptr)
+        return {};
+    return { reinterpret_cast<const char*>(mFile.Data() + mHeader->NameOffset + entry.NameOffset), entry.NameLength };
+}
+
+const AssetPackEntry* AssetPack::Find(std::wstring_view path) const
+{
+    if (mHeader == nullptr)
+        return nullptr;
+
+    const std::string name = NormalizePath(path);
+    const uint64_t hash = HashPath(name);
+
+    const auto entries = Entries();
+    auto it = std::lower_bound(entries.begin(), entries.end(), hash,
+        [](const AssetPackEntry& entry, uint64_t value) { return entry.PathHash < value; });
+    for (; it != entries.end() && it->PathHash == hash; ++it)
+    {
+        if (Name(*it) != name)
+            continue;
+
+        // The pack is written after the files it holds, so a newer loose
+        // file was edited since.
+        std::error_code error;
+        const auto looseTime = std::filesystem::last_write_time(std::filesystem::path(path), error);
+        if (!error && looseTime > mWriteTime)
+        {
+            OutputDebugStringW((L"Loose file " + std::wstring(path) + L" is newer than the asset pack; using it.\n").c_str());
+            return nullptr;
+        }
+        return &*it;
+    }
+    return nullptr;
+}
+
+std::span<const uint8_t> AssetPack::Read(const AssetPackEntry& entry, std::unique_ptr<uint8_t[]>& storage) const
+{
+    if (mHeader == nullptr)
+        return {};
+
+    const uint8_t* stored = mFile.Data() + entry.Offset;
+    if ((entry.Flags & AssetPackEntry::Compressed) == 0)
+        return { stored, (size_t)entry.Size };
+
+    storage = std::make_unique<uint8_t[]>((size_t)entry.Size);
+    if (!Decompress(stored, (size_t)entry.StoredSize, storage.get(), (size_t)entry.Size))
+    {
+        storage.reset();
+        return {};
+    }
+    return { storage.get(), (size_t)entry.Size };
+}
+
+std::string AssetPack::NormalizePath(std::wstring_view path)
+{
+    const std::u8string utf8 = std::filesystem::path(path).generic_u8string();
+    std::string name(reinterpret_cast<const char*>(utf8.data()), utf8.size());
+    for (char& c : name)
+    {
+        if (c == '\\')
+            c = '/';
+        else if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+    }
+
+    size_t start = 0;
+    while (name.compare(start, 2, "./") == 0)
+        start += 2;
+    return name.substr(start);
+}
+
+uint64_t AssetPack::HashPath(std::string_view normalizedPath)
+{
+    return FileUtil::Hash(normalizedPath.data(), normalizedPath.size());
+}
+
+bool AssetPack::Write(const std::wstring& fileName, const std::wstring& directory,
+    const std::vector<std::wstring>& excluded, const std::vector<std::wstring>& inPlaceExtensions)
+{
+    namespace fs = std::filesystem;
+
+    struct Source
+    {
+        fs::path Path;
+        std::string Name;
+        uint64_t Hash;
+    };
+
+    const fs::path root(directory);
+    const fs::path base = root.parent_path();
+
+    std::vector<std::string> excludedNames;
+    for (const auto& path : excluded)
+        excludedNames.push_back(NormalizePath(fs::path(path).lexically_relative(base).wstring()));
+
+    std::error_code error;
+    std::vector<Source> sources;
+    for (fs::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error))
+    {
+        if (!it->is_regular_file(error))
+            continue;
+
+        Source source;
+        source.Path = it->path();
+        source.Name = NormalizePath(source.Path.lexically_relative(base).wstring());
+        bool skip = std::any_of(excludedNames.begin(), excludedNames.end(), [&](const std::string& excludedName)
+        {
+            return source.Name.compare(0, excludedName.size(), excludedName) == 0 &&
+                (source.Name.size() == excludedName.size() || source.Name[excludedName.size()] == '/');
+        });
+        if (skip)
+            continue;
+        source.Hash = HashPath(source.Name);
+        sources.push_back(std::move(source));
+    }
+    if (error)
+        return false;
+
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b)
+        { return a.Hash != b.Hash ? a.Hash < b.Hash : a.Name < b.Name; });
+
+    AssetPackHeader header;
+    header.EntryCount = (uint32_t)sources.size();
+    header.EntryOffset = sizeof(AssetPackHeader);
+    header.NameOffset = header.EntryOffset + sources.size() * sizeof(AssetPackEntry);
+
+    std::vector<AssetPackEntry> entries(sources.size());
+    std::string names;
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        entries[i].PathHash = sources[i].Hash;
+        entries[i].NameOffset = (uint32_t)names.size();
+        entries[i].NameLength = (uint32_t)sources[i].Name.size();
+        names += sources[i].Name;
+    }
+    header.NameSize = names.size();
+
+    // Written aside and moved into place, so a failed pack never replaces
+    // a good one.
+    return FileUtil::WriteAtomically(fileName, [&](std::ofstream& file)
+    {
+        // The table of contents is rewritten once the payload offsets are known.
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+        file.write(names.data(), names.size());
+
+        const char zeros[AssetPackHeader::PayloadAlignment] = {};
+        uint64_t offset = header.NameOffset + header.NameSize;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            const uint64_t size = fs::file_size(sources[i].Path, error);
+            std::vector<uint8_t> contents(error ? 0 : (size_t)size);
+            std::ifstream input(sources[i].Path, std::ios::binary);
+            if (error || !input.read(reinterpret_cast<char*>(contents.data()), (std::streamsize)contents.size()))
+            {
+                file.setstate(std::ios::failbit);
+                return;
+            }
+
+            AssetPackEntry& entry = entries[i];
+            entry.Size = contents.size();
+
+            std::wstring extension = sources[i].Path.extension().wstring();
+            std::transform(extension.begin(), extension.end(), extension.begin(), std::towlower);
+            bool inPlace = std::find(inPlaceExtensions.begin(), inPlaceExtensions.end(), extension) != inPlaceExtensions.end();
+
+            std::vector<uint8_t> compressed;
+            if (!inPlace)
+                compressed = Compress(contents.data(), contents.size());
+            const std::vector<uint8_t>& stored =
+                !inPlace && compressed.size() <= contents.size() - (contents.size() >> MinSavingShift) ? compressed : contents;
+            if (&stored == &compressed)
+                entry.Flags |= AssetPackEntry::Compressed;
+            entry.StoredSize = stored.size();
+
+            entry.Offset = AlignUp(offset, AssetPackHeader::PayloadAlignment);
+            file.write(zeros, (std::streamsize)(entry.Offset - offset));
+            file.write(reinterpret_cast<const char*>(stored.data()), (std::streamsize)stored.size());
+            offset = entry.Offset + entry.StoredSize;
+        }
+        header.FileSize = offset;
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+    });
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+//
+// Asset pack layout (all little endian):
+//
+//   AssetPackHeader
+//   AssetPackEntry[EntryCount]    sorted by PathHash
+//   name table                    UTF-8 paths, not terminated
+//   payloads                      each PayloadAlignment aligned
+//
+// Paths are stored normalized: lower case, '/' separated and without a
+// leading "./", so "./Assets/Shaders/Sky.hlsl" and "assets\shaders\sky.hlsl"
+// name the same entry. A lookup is a binary search over the hashes followed
+// by a name compare.
+//
+// Payloads are stored as they are or, when that saves enough space, LZ
+// compressed (the LZ4 block format). Stored payloads are served straight
+// from the mapping.
+//
+struct AssetPackHeader
+{
+    static constexpr uint32_t MagicValue = 0x4B50584C; // "LXPK"
+    static constexpr uint32_t CurrentVersion = 1;
+    static constexpr uint64_t PayloadAlignment = 4096;
+
+    uint32_t Magic = MagicValue;
+    uint32_t Version = CurrentVersion;
+    uint32_t HeaderSize = sizeof(AssetPackHeader);
+    uint32_t EntryCount = 0;
+    uint64_t FileSize = 0;
+
+    uint64_t EntryOffset = 0;
+    uint64_t NameOffset = 0;
+    uint64_t NameSize = 0;
+    uint64_t Reserved[2] = {};
+};
+
+struct AssetPackEntry
+{
+    static constexpr uint32_t Compressed = 0x1;
+
+    uint64_t PathHash = 0;
+    uint64_t Offset = 0;
+    uint64_t StoredSize = 0;
+    uint64_t Size = 0;          // after decompression
+    uint32_t NameOffset = 0;    // into the name table
+    uint32_t NameLength = 0;
+    uint32_t Flags = 0;
+    uint32_t Reserved = 0;
+};
+
+static_assert(sizeof(AssetPackHeader) == 64);
+static_assert(sizeof(AssetPackEntry) == 48);
+
+class AssetPack
+{
+public:
+    // Maps the pack and validates the header and the entry bounds.
+    bool Open(const std::wstring& fileName);
+    void Close();
+    bool IsOpen() const;
+
+    // Null if the pack isn't open or has no such file. Also null when the
+    // loose file at path was changed after the pack was written, so edits
+    // show up without repacking.
+    const AssetPackEntry* Find(std::wstring_view path) const;
+
+    // Contents of an entry. Stored entries point into the mapping, which stays
+    // valid while the pack is open; compressed ones are decompressed into
+    // storage. Empty if the payload is corrupt.
+    std::span<const uint8_t> Read(const AssetPackEntry& entry, std::unique_ptr<uint8_t[]>& storage) const;
+
+    std::span<const AssetPackEntry> Entries() const;
+    std::string_view Name(const AssetPackEntry& entry) const;
+
+    static std::string NormalizePath(std::wstring_view path);
+    static uint64_t HashPath(std::string_view normalizedPath);
+
+    // Packs every file below directory, except the files and directories
+    // named in excluded.
+    // Entries are named by their path relative to directory's parent, so
+    // packing "./Assets" serves "./Assets/...". Files named with one of the
+    // inPlaceExtensions (".dds") are never compressed, so they can be used
+    // straight from the mapping.
+    static bool Write(const std::wstring& fileName, const std::wstring& directory,
+        const std::vector<std::wstring>& excluded = {},
+        const std::vector<std::wstring>& inPlaceExtensions = { L".dds" });
+
+private:
+    MappedFile mFile;
+    const AssetPackHeader* mHeader = nullptr;
+    std::filesystem::file_time_type mWriteTime;
+};
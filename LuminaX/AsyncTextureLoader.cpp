@@ -0,0 +1,204 @@
+#include "AsyncTextureLoader.h"
+#include "directx/d3dx12.h"
+#include "UploadManager.h"
+#include <algorithm>
+
+AsyncTextureLoader::AsyncTextureLoader(ID3D12Device* device, GpuHeapAllocator* allocator, UploadManager* uploader,
+    UINT workerCount, size_t maxQueuedBytes, size_t uploadBytesPerUpdate)
+    : md3dDevice(device), mUploader(uploader),
+      mMaxQueuedBytes(maxQueuedBytes), mUploadBytesPerUpdate(uploadBytesPerUpdate)
+{
+    CreateFallback(allocator);
+
+    workerCount = std::max(workerCount, 1u);
+    for (UINT i = 0; i < workerCount; ++i)
+        mWorkers.emplace_back(&AsyncTextureLoader::WorkerMain, this);
+}
+
+AsyncTextureLoader::~AsyncTextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mJobReady.notify_all();
+    mSpaceReady.notify_all();
+
+    for (auto& worker : mWorkers)
+        worker.join();
+}
+
+uint32_t AsyncTextureLoader::Request(const std::wstring& fileName, const TextureImportOptions& options, bool streamed,
+    bool keepDecoded)
+{
+    uint32_t ticket = mNextTicket++;
+    mPendingCount++;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back({ ticket, fileName, options, streamed, keepDecoded });
+    }
+    mJobReady.notify_one();
+    return ticket;
+}
+
+void AsyncTextureLoader::Update(std::vector<TextureLoadResult>& results)
+{
+    // Take decoded textures up to the budget, but always at least one so that
+    // a single large texture still gets through.
+    std::vector<Decoded> batch;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        size_t bytes = 0;
+        while (!mDecoded.empty() && (batch.empty() || bytes + mDecoded.front().ByteSize <= mUploadBytesPerUpdate))
+        {
+            bytes += mDecoded.front().ByteSize;
+            mDecodedBytes -= mDecoded.front().ByteSize;
+            batch.push_back(std::move(mDecoded.front()));
+            mDecoded.pop_front();
+        }
+    }
+    if (!batch.empty())
+        mSpaceReady.notify_all();
+
+    // The uploader copies the data into staging memory, so the decoded
+    // images are released at the end of this scope. Streamed ones are handed
+    // over as they are, kept ones once their upload completes.
+    std::vector<InFlight> uploaded;
+    for (auto& decoded : batch)
+    {
+        if (!decoded.Succeeded)
+        {
+            results.push_back({ decoded.Ticket, nullptr });
+            mPendingCount--;
+            continue;
+        }
+        if (decoded.Streamed)
+        {
+            results.push_back({ decoded.Ticket, nullptr, std::make_unique<DecodedTexture>(std::move(decoded.Texture)) });
+            mPendingCount--;
+            continue;
+        }
+
+        mUploader->UploadToTexture(decoded.Texture.Resource.Get(), 0, decoded.Texture.Subresources);
+        uploaded.push_back({ 0, decoded.Ticket, decoded.Texture.Resource,
+            decoded.KeepDecoded ? std::make_unique<DecodedTexture>(std::move(decoded.Texture)) : nullptr });
+    }
+
+    if (!uploaded.empty())
+    {
+        UINT64 fence = mUploader->Submit();
+        for (auto& texture : uploaded)
+        {
+            texture.Fence = fence;
+            mInFlight.push_back(std::move(texture));
+        }
+    }
+
+    while (!mInFlight.empty() && mUploader->IsComplete(mInFlight.front().Fence))
+    {
+        results.push_back({ mInFlight.front().Ticket, std::move(mInFlight.front().Resource),
+            std::move(mInFlight.front().Decoded) });
+        mInFlight.pop_front();
+        mPendingCount--;
+    }
+}
+
+void AsyncTextureLoader::Wait(uint32_t ticket, std::vector<TextureLoadResult>& results)
+{
+    for (;;)
+    {
+        size_t first = results.size();
+        Update(results);
+        for (size_t i = first; i < results.size(); ++i)
+        {
+            if (results[i].Ticket == ticket)
+                return;
+        }
+
+        if (!mInFlight.empty())
+        {
+            mUploader->WaitIdle();
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mDecodedReady.wait(lock, [&] { return !mDecoded.empty(); });
+        }
+    }
+}
+
+size_t AsyncTextureLoader::PendingCount() const
+{
+    return mPendingCount;
+}
+
+ID3D12Resource* AsyncTextureLoader::Fallback() const
+{
+    return mFallback.Get();
+}
+
+void AsyncTextureLoader::WorkerMain()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobReady.wait(lock, [&] { return mStop || !mJobs.empty(); });
+            if (mStop)
+                return;
+
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        Decoded decoded;
+        decoded.Ticket = job.Ticket;
+        decoded.Streamed = job.Streamed;
+        decoded.KeepDecoded = job.KeepDecoded;
+        try
+        {
+            decoded.Succeeded = GraphicsUtil::DecodeTextureFromFile(job.FileName, md3dDevice, decoded.Texture, job.Options);
+        }
+        catch (const DxException& e)
+        {
+            OutputDebugStringW((e.ToString() + L"\n").c_str());
+            decoded.Succeeded = false;
+        }
+        catch (const std::exception&)
+        {
+            decoded.Succeeded = false;
+        }
+        if (decoded.Succeeded)
+            decoded.ByteSize = decoded.Texture.ByteSize();
+        else
+            decoded.Texture = DecodedTexture();
+
+        {
+            // An empty queue always takes the texture, however large it is.
+            std::unique_lock<std::mutex> lock(mMutex);
+            mSpaceReady.wait(lock, [&] {
+                return mStop || mDecoded.empty() || mDecodedBytes + decoded.ByteSize <= mMaxQueuedBytes;
+            });
+            if (mStop)
+                return;
+
+            mDecodedBytes += decoded.ByteSize;
+            mDecoded.push_back(std::move(decoded));
+        }
+        mDecodedReady.notify_one();
+    }
+}
+
+void AsyncTextureLoader::CreateFallback(GpuHeapAllocator* allocator)
+{
+    auto desc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1);
+    mFallback = allocator->CreateResource(desc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+
+    const uint32_t white = 0xFFFFFFFF;
+    D3D12_SUBRESOURCE_DATA subresource;
+    subresource.pData = &white;
+    subresource.RowPitch = sizeof(white);
+    subresource.SlicePitch = sizeof(white);
+    mUploader->UploadToTexture(mFallback.Get(), 0, { &subresource, 1 });
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GpuHeapAllocator.h"
+#include "GraphicsUtil.h"
+
+class UploadManager;
+
+struct TextureLoadResult
+{
+    uint32_t Ticket = 0;
+    // Null when the file could not be read or decoded.
+    Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+    // Streamed requests get the decoded levels instead, nothing is uploaded.
+    // Requests that keep their decoded levels get both.
+    std::unique_ptr<DecodedTexture> Decoded;
+};
+
+// Loads textures in the background. Worker threads read and decode the files
+// and create the resources; the decoded images wait in a queue that is
+// bounded in bytes, so workers stall instead of decoding far ahead of the
+// uploads. Update, called on the main thread once per frame, hands a
+// budgeted amount of that queue to the UploadManager and reports the
+// textures whose copies have completed.
+//
+// Until a texture is reported, users bind Fallback(), a 1x1 white texture.
+class AsyncTextureLoader
+{
+public:
+    AsyncTextureLoader(ID3D12Device* device, GpuHeapAllocator* allocator, UploadManager* uploader,
+        UINT workerCount, size_t maxQueuedBytes, size_t uploadBytesPerUpdate);
+    ~AsyncTextureLoader();
+
+    AsyncTextureLoader(const AsyncTextureLoader& rhs) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader& rhs) = delete;
+
+    // Queues a file for loading. Returns the ticket its result is reported with.
+    // Streamed textures are reported as soon as they are decoded, for the
+    // TextureStreamer to upload. With keepDecoded the decoded levels are
+    // reported along with the uploaded texture, for work on the CPU that
+    // would otherwise decode the file a second time.
+    uint32_t Request(const std::wstring& fileName, const TextureImportOptions& options = {}, bool streamed = false,
+        bool keepDecoded = false);
+
+    // Main thread only. Appends the textures that became resident (or failed).
+    void Update(std::vector<TextureLoadResult>& results);
+    // Blocks until the given ticket is done; everything finished meanwhile
+    // is appended to results as well.
+    void Wait(uint32_t ticket, std::vector<TextureLoadResult>& results);
+
+    // Requests that have not been reported yet.
+    size_t PendingCount() const;
+
+    ID3D12Resource* Fallback() const;
+
+private:
+    struct Job
+    {
+        uint32_t Ticket;
+        std::wstring FileName;
+        TextureImportOptions Options;
+        bool Streamed = false;
+        bool KeepDecoded = false;
+    };
+
+    struct Decoded
+    {
+        uint32_t Ticket = 0;
+        bool Succeeded = false;
+        bool Streamed = false;
+        bool KeepDecoded = false;
+        DecodedTexture Texture;
+        size_t ByteSize = 0;
+    };
+
+    struct InFlight
+    {
+        UINT64 Fence;
+        uint32_t Ticket;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        std::unique_ptr<DecodedTexture> Decoded;
+    };
+
+    void WorkerMain();
+    void CreateFallback(GpuHeapAllocator* allocator);
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    UploadManager* mUploader = nullptr;
+    const size_t mMaxQueuedBytes;
+    const size_t mUploadBytesPerUpdate;
+
+    GpuResource mFallback;
+
+    std::vector<std::thread> mWorkers;
+    bool mStop = false;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mJobReady;
+    std::condition_variable mDecodedReady;
+    std::condition_variable mSpaceReady;
+    std::deque<Job> mJobs;
+    std::deque<Decoded> mDecoded;
+    size_t mDecodedBytes = 0;
+
+    // Main thread state.
+    uint32_t mNextTicket = 1;
+    size_t mPendingCount = 0;
+    std::deque<InFlight> mInFlight;
+};
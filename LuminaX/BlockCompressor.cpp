@@ -0,0 +1,598 @@
+#include "BlockCompressor.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // Block rows per thread below which fewer threads are used.
+    constexpr uint32_t MinBlockRowsPerThread = 4;
+
+    // The 16 texels of a 4x4 block as RGBA in [0, 255].
+    struct Block
+    {
+        float Texels[16][4];
+    };
+
+    bool IsBgra(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_B8G8R8A8_UNORM || format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+    }
+
+    bool IsSrgb(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+    }
+
+    void FetchBlock(const D3D12_SUBRESOURCE_DATA& level, UINT width, UINT height,
+        UINT blockX, UINT blockY, bool bgra, Block& block)
+    {
+        // Levels smaller than a block repeat their last row and column.
+        for (UINT y = 0; y < 4; ++y)
+        {
+            const UINT sourceY = std::min(blockY * 4 + y, height - 1);
+            const uint8_t* row = static_cast<const uint8_t*>(level.pData) + level.RowPitch * sourceY;
+            for (UINT x = 0; x < 4; ++x)
+            {
+                const uint8_t* texel = row + 4 * std::min(blockX * 4 + x, width - 1);
+                float* dest = block.Texels[y * 4 + x];
+                dest[0] = texel[bgra ? 2 : 0];
+                dest[1] = texel[1];
+                dest[2] = texel[bgra ? 0 : 2];
+                dest[3] = texel[3];
+            }
+        }
+    }
+
+    // Fits a line through the texels selected by mask (all of them if null),
+    // using the first channels channels, and returns its extremes.
+    void FitEndpoints(const Block& block, int channels, const bool* mask, float e0[4], float e1[4])
+    {
+        float mean[4] = {};
+        int count = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            if (mask && !mask[i])
+                continue;
+            for (int c = 0; c < channels; ++c)
+                mean[c] += block.Texels[i][c];
+            count++;
+        }
+        if (count == 0)
+        {
+            std::fill(e0, e0 + 4, 0.0f);
+            std::fill(e1, e1 + 4, 0.0f);
+            return;
+        }
+        for (int c = 0; c < channels; ++c)
+            mean[c] /= count;
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            if (mask && !mask[i])
+                continue;
+            for (int a = 0; a < channels; ++a)
+            {
+                for (int b = 0; b < channels; ++b)
+                    covariance[a][b] += (block.Texels[i][a] - mean[a]) * (block.Texels[i][b] - mean[b]);
+            }
+        }
+
+        // Power iteration for the principal axis, starting from the channel
+        // with the largest variance.
+        float axis[4] = {};
+        int largest = 0;
+        for (int c = 1; c < channels; ++c)
+        {
+            if (covariance[c][c] > covariance[largest][largest])
+                largest = c;
+        }
+        axis[largest] = 1.0f;
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4] = {};
+            float lengthSq = 0.0f;
+            for (int a = 0; a < channels; ++a)
+            {
+                for (int b = 0; b < channels; ++b)
+                    next[a] += covariance[a][b] * axis[b];
+                lengthSq += next[a] * next[a];
+            }
+            if (lengthSq < 1e-12f)
+                break;
+
+            const float invLength = 1.0f / std::sqrt(lengthSq);
+            for (int a = 0; a < channels; ++a)
+                axis[a] = next[a] * invLength;
+        }
+
+        float minT = FLT_MAX;
+        float maxT = -FLT_MAX;
+        for (int i = 0; i < 16; ++i)
+        {
+            if (mask && !mask[i])
+                continue;
+            float t = 0.0f;
+            for (int c = 0; c < channels; ++c)
+                t += (block.Texels[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < channels; ++c)
+        {
+            e0[c] = std::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+            e1[c] = std::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+        }
+    }
+
+    // Least squares endpoints for texels that sit at weights[i] between e0 and
+    // e1. Texels with a negative weight are ignored. The endpoints are kept
+    // when all texels use the same weight.
+    void RefineEndpoints(const Block& block, int channels, const float weights[16], float e0[4], float e1[4])
+    {
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        float ax[4] = {};
+        float bx[4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            const float w = weights[i];
+            if (w < 0.0f)
+                continue;
+
+            const float a = 1.0f - w;
+            aa += a * a;
+            ab += a * w;
+            bb += w * w;
+            for (int c = 0; c < channels; ++c)
+            {
+                ax[c] += a * block.Texels[i][c];
+                bx[c] += w * block.Texels[i][c];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return;
+
+        const float invDeterminant = 1.0f / determinant;
+        for (int c = 0; c < channels; ++c)
+        {
+            e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) * invDeterminant, 0.0f, 255.0f);
+            e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) * invDeterminant, 0.0f, 255.0f);
+        }
+    }
+
+    uint16_t To565(const float color[4])
+    {
+        const int r = std::clamp((int)std::lround(color[0] * 31.0f / 255.0f), 0, 31);
+        const int g = std::clamp((int)std::lround(color[1] * 63.0f / 255.0f), 0, 63);
+        const int b = std::clamp((int)std::lround(color[2] * 31.0f / 255.0f), 0, 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void From565(uint16_t value, int color[3])
+    {
+        const int r = (value >> 11) & 31;
+        const int g = (value >> 5) & 63;
+        const int b = value & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Encodes a BC1 block, or the color half of a BC3 block. BC1 blocks use the
+    // three color mode when any texel has alpha below 128, with index 3
+    // meaning transparent; BC3 color is always decoded as four colors.
+    void EncodeColor(const Block& block, bool bc1, int refinements, uint8_t* out)
+    {
+        static const float FourColorWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static const float ThreeColorWeights[4] = { 0.0f, 1.0f, 0.5f, -1.0f };
+
+        bool opaque[16];
+        bool anyTransparent = false;
+        for (int i = 0; i < 16; ++i)
+        {
+            opaque[i] = !bc1 || block.Texels[i][3] >= 128.0f;
+            anyTransparent |= !opaque[i];
+        }
+
+        float e0[4];
+        float e1[4];
+        FitEndpoints(block, 3, opaque, e0, e1);
+
+        uint16_t bestColors[2] = {};
+        uint32_t bestIndices = 0;
+        float bestError = FLT_MAX;
+        for (int pass = 0; ; ++pass)
+        {
+            // BC1 picks the mode from the endpoint order: four colors when
+            // color0 > color1, three colors otherwise.
+            uint16_t color0 = To565(e0);
+            uint16_t color1 = To565(e1);
+            if (anyTransparent ? color0 > color1 : color0 < color1)
+                std::swap(color0, color1);
+            const bool threeColor = bc1 && (anyTransparent || color0 == color1);
+
+            int palette[4][3];
+            From565(color0, palette[0]);
+            From565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                if (threeColor)
+                {
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                    palette[3][c] = 0;
+                }
+                else
+                {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+            }
+            const uint32_t colorCount = threeColor && anyTransparent ? 3 : 4;
+
+            uint32_t indices = 0;
+            float error = 0.0f;
+            float weights[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                uint32_t index = 3;
+                float indexError = 0.0f;
+                if (opaque[i])
+                {
+                    indexError = FLT_MAX;
+                    for (uint32_t k = 0; k < colorCount; ++k)
+                    {
+                        float distance = 0.0f;
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            const float d = block.Texels[i][c] - palette[k][c];
+                            distance += d * d;
+                        }
+                        if (distance < indexError)
+                        {
+                            indexError = distance;
+                            index = k;
+                        }
+                    }
+                }
+
+                indices |= index << (2 * i);
+                error += indexError;
+                weights[i] = threeColor ? ThreeColorWeights[index] : FourColorWeights[index];
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                bestColors[0] = color0;
+                bestColors[1] = color1;
+                bestIndices = indices;
+            }
+            if (pass == refinements || error == 0.0f)
+                break;
+
+            // Refine from the quantized endpoints, in the order they are stored.
+            for (int c = 0; c < 3; ++c)
+            {
+                e0[c] = (float)palette[0][c];
+                e1[c] = (float)palette[1][c];
+            }
+            RefineEndpoints(block, 3, weights, e0, e1);
+        }
+
+        out[0] = (uint8_t)(bestColors[0] & 0xFF);
+        out[1] = (uint8_t)(bestColors[0] >> 8);
+        out[2] = (uint8_t)(bestColors[1] & 0xFF);
+        out[3] = (uint8_t)(bestColors[1] >> 8);
+        for (int b = 0; b < 4; ++b)
+            out[4 + b] = (uint8_t)(bestIndices >> (8 * b));
+    }
+
+    // Encodes one channel as a BC4 block (also the alpha of BC3 and the halves
+    // of BC5), interpolating eight values between the channel's extremes.
+    void EncodeChannel(const Block& block, int channel, uint8_t* out)
+    {
+        float low = 255.0f;
+        float high = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            low = std::min(low, block.Texels[i][channel]);
+            high = std::max(high, block.Texels[i][channel]);
+        }
+
+        const int a0 = (int)std::lround(high);
+        const int a1 = (int)std::lround(low);
+        out[0] = (uint8_t)a0;
+        out[1] = (uint8_t)a1;
+
+        // With a0 == a1 the block decodes in six value mode, where index 0
+        // is still a0, so all-zero indices are exact.
+        uint64_t indices = 0;
+        if (a0 > a1)
+        {
+            int palette[8] = { a0, a1 };
+            for (int k = 2; k < 8; ++k)
+                palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                uint64_t index = 0;
+                float indexError = FLT_MAX;
+                for (int k = 0; k < 8; ++k)
+                {
+                    const float d = std::fabs(block.Texels[i][channel] - palette[k]);
+                    if (d < indexError)
+                    {
+                        indexError = d;
+                        index = (uint64_t)k;
+                    }
+                }
+                indices |= index << (3 * i);
+            }
+        }
+
+        for (int b = 0; b < 6; ++b)
+            out[2 + b] = (uint8_t)(indices >> (8 * b));
+    }
+
+    // BC7 interpolation weights for 4 bit indices, in 64ths.
+    const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct Mode6Block
+    {
+        int Endpoints[2][4] = {};   // 7 bits per channel
+        int PBits[2] = {};
+        uint8_t Indices[16] = {};
+        float Error = FLT_MAX;
+    };
+
+    void QuantizeEndpoint(const float endpoint[4], int pbit, int quantized[4])
+    {
+        for (int c = 0; c < 4; ++c)
+            quantized[c] = std::clamp((int)std::lround((endpoint[c] - pbit) * 0.5f), 0, 127);
+    }
+
+    float QuantizationError(const float endpoint[4], int pbit)
+    {
+        int quantized[4];
+        QuantizeEndpoint(endpoint, pbit, quantized);
+
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c)
+        {
+            const float d = endpoint[c] - (float)((quantized[c] << 1) | pbit);
+            error += d * d;
+        }
+        return error;
+    }
+
+    void EvaluateMode6(const Block& block, const float e0[4], const float e1[4], int p0, int p1, Mode6Block& result)
+    {
+        QuantizeEndpoint(e0, p0, result.Endpoints[0]);
+        QuantizeEndpoint(e1, p1, result.Endpoints[1]);
+        result.PBits[0] = p0;
+        result.PBits[1] = p1;
+
+        int palette[16][4];
+        for (int c = 0; c < 4; ++c)
+        {
+            const int a = (result.Endpoints[0][c] << 1) | p0;
+            const int b = (result.Endpoints[1][c] << 1) | p1;
+            for (int k = 0; k < 16; ++k)
+                palette[k][c] = ((64 - BC7Weights[k]) * a + BC7Weights[k] * b + 32) >> 6;
+        }
+
+        result.Error = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float indexError = FLT_MAX;
+            for (int k = 0; k < 16; ++k)
+            {
+                float distance = 0.0f;
+                for (int c = 0; c < 4; ++c)
+                {
+                    const float d = block.Texels[i][c] - palette[k][c];
+                    distance += d * d;
+                }
+                if (distance < indexError)
+                {
+                    indexError = distance;
+                    result.Indices[i] = (uint8_t)k;
+                }
+            }
+            result.Error += indexError;
+        }
+    }
+
+    // Packs fields least significant bit first, as BC7 blocks are laid out.
+    struct BitWriter
+    {
+        uint8_t* Data;
+        uint32_t Position = 0;
+
+        void Write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t i = 0; i < bits; ++i, ++Position)
+            {
+                if ((value >> i) & 1)
+                    Data[Position >> 3] |= (uint8_t)(1u << (Position & 7));
+            }
+        }
+    };
+
+    void EncodeBC7(const Block& block, BlockCompressor::Quality quality, uint8_t* out)
+    {
+        float e0[4];
+        float e1[4];
+        FitEndpoints(block, 4, nullptr, e0, e1);
+
+        const int refinements = quality == BlockCompressor::Quality::Fast ? 0
+            : quality == BlockCompressor::Quality::Normal ? 1 : 3;
+
+        Mode6Block best;
+        for (int pass = 0; ; ++pass)
+        {
+            Mode6Block candidate;
+            if (quality == BlockCompressor::Quality::Fast)
+            {
+                const int p0 = QuantizationError(e0, 1) < QuantizationError(e0, 0) ? 1 : 0;
+                const int p1 = QuantizationError(e1, 1) < QuantizationError(e1, 0) ? 1 : 0;
+                EvaluateMode6(block, e0, e1, p0, p1, candidate);
+                if (candidate.Error < best.Error)
+                    best = candidate;
+            }
+            else
+            {
+                for (int pbits = 0; pbits < 4; ++pbits)
+                {
+                    EvaluateMode6(block, e0, e1, pbits & 1, pbits >> 1, candidate);
+                    if (candidate.Error < best.Error)
+                        best = candidate;
+                }
+            }
+            if (pass == refinements || best.Error == 0.0f)
+                break;
+
+            float weights[16];
+            for (int i = 0; i < 16; ++i)
+                weights[i] = BC7Weights[best.Indices[i]] / 64.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                e0[c] = (float)((best.Endpoints[0][c] << 1) | best.PBits[0]);
+                e1[c] = (float)((best.Endpoints[1][c] << 1) | best.PBits[1]);
+            }
+            RefineEndpoints(block, 4, weights, e0, e1);
+        }
+
+        // The first texel's index is stored without its top bit, so it must
+        // be below 8; otherwise swap the endpoints and invert the indices.
+        if (best.Indices[0] >= 8)
+        {
+            std::swap(best.Endpoints[0], best.Endpoints[1]);
+            std::swap(best.PBits[0], best.PBits[1]);
+            for (int i = 0; i < 16; ++i)
+                best.Indices[i] = (uint8_t)(15 - best.Indices[i]);
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer{ out };
+        writer.Write(1u << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.Write((uint32_t)best.Endpoints[0][c], 7);
+            writer.Write((uint32_t)best.Endpoints[1][c], 7);
+        }
+        writer.Write((uint32_t)best.PBits[0], 1);
+        writer.Write((uint32_t)best.PBits[1], 1);
+        writer.Write(best.Indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+            writer.Write(best.Indices[i], 4);
+    }
+}
+
+bool BlockCompressor::CanCompress(DXGI_FORMAT source, UINT width, UINT height)
+{
+    switch (source)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        return width % 4 == 0 && height % 4 == 0;
+    default:
+        return false;
+    }
+}
+
+DXGI_FORMAT BlockCompressor::CompressedFormat(Format format, DXGI_FORMAT source)
+{
+    const bool srgb = IsSrgb(source);
+    switch (format)
+    {
+    case Format::BC1:
+        return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+    case Format::BC3:
+        return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+    case Format::BC5:
+        return DXGI_FORMAT_BC5_UNORM;
+    case Format::BC7:
+        return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+    default:
+        return source;
+    }
+}
+
+void BlockCompressor::Compress(Format format, Quality quality, DXGI_FORMAT source, UINT width, UINT height,
+    const std::vector<D3D12_SUBRESOURCE_DATA>& levels,
+    std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+    assert(format != Format::None && CanCompress(source, width, height));
+
+    const bool bgra = IsBgra(source);
+    const size_t blockBytes = format == Format::BC1 ? 8 : 16;
+    const size_t levelCount = levels.size();
+
+    std::vector<size_t> offsets(levelCount);
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < levelCount; ++i)
+    {
+        const size_t blocksWide = (std::max(width >> i, 1u) + 3) / 4;
+        const size_t blocksHigh = (std::max(height >> i, 1u) + 3) / 4;
+        offsets[i] = totalBytes;
+        totalBytes += blocksWide * blocksHigh * blockBytes;
+    }
+
+    data = std::make_unique<uint8_t[]>(totalBytes);
+    subresources.resize(levelCount);
+    for (size_t i = 0; i < levelCount; ++i)
+    {
+        const UINT levelWidth = std::max(width >> i, 1u);
+        const UINT levelHeight = std::max(height >> i, 1u);
+        const UINT blocksWide = (levelWidth + 3) / 4;
+        const UINT blocksHigh = (levelHeight + 3) / 4;
+        const size_t rowPitch = blocksWide * blockBytes;
+        uint8_t* dest = data.get() + offsets[i];
+
+        subresources[i].pData = dest;
+        subresources[i].RowPitch = (LONG_PTR)rowPitch;
+        subresources[i].SlicePitch = (LONG_PTR)(rowPitch * blocksHigh);
+
+        ParallelFor(blocksHigh, MinBlockRowsPerThread, [&](uint32_t begin, uint32_t end)
+        {
+            Block block;
+            for (UINT blockY = begin; blockY < end; ++blockY)
+            {
+                for (UINT blockX = 0; blockX < blocksWide; ++blockX)
+                {
+                    FetchBlock(levels[i], levelWidth, levelHeight, blockX, blockY, bgra, block);
+                    uint8_t* out = dest + rowPitch * blockY + blockBytes * blockX;
+                    switch (format)
+                    {
+                    case Format::BC1:
+                        EncodeColor(block, true, 1, out);
+                        break;
+                    case Format::BC3:
+                        EncodeChannel(block, 3, out);
+                        EncodeColor(block, false, 1, out + 8);
+                        break;
+                    case Format::BC5:
+                        EncodeChannel(block, 0, out);
+                        EncodeChannel(block, 1, out + 8);
+                        break;
+                    default:
+                        EncodeBC7(block, quality, out);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// CPU encoder for the BC block formats, used when importing textures.
+//
+// BC1 and BC3 are fast paths: endpoints come from the principal axis of each
+// block and are refined once by least squares. BC5 stores the red and green
+// channels (normal maps). BC7 uses mode 6 (one subset, RGBA endpoints with
+// per-endpoint p-bits, 4 bit indices); Quality selects how much effort goes
+// into the endpoints. Block rows are split across threads.
+class BlockCompressor
+{
+public:
+    enum class Format
+    {
+        None,
+        BC1,
+        BC3,
+        BC5,
+        BC7
+    };
+
+    enum class Quality
+    {
+        // Principal axis endpoints, p-bits picked per endpoint.
+        Fast,
+        // One refinement pass, all p-bit combinations tried.
+        Normal,
+        // Three refinement passes.
+        High
+    };
+
+    // Bumped whenever the encoders change, so stale cached results are ignored.
+    static constexpr uint32_t Version = 1;
+
+    // The source must be RGBA8/BGRA8 (UNORM or UNORM_SRGB), and the top
+    // level a multiple of 4 texels in each direction as D3D12 requires.
+    static bool CanCompress(DXGI_FORMAT source, UINT width, UINT height);
+
+    // BC format for the source format; sRGB is kept where the format has it.
+    static DXGI_FORMAT CompressedFormat(Format format, DXGI_FORMAT source);
+
+    // Compresses every level of levels. data receives the blocks of all
+    // levels tightly packed and subresources point into it.
+    static void Compress(Format format, Quality quality, DXGI_FORMAT source, UINT width, UINT height,
+        const std::vector<D3D12_SUBRESOURCE_DATA>& levels,
+        std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources);
+};
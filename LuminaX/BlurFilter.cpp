@@ -1,10 +1,11 @@
 #include "BlurFilter.h"
 
-BlurFilter::BlurFilter(ID3D12Device* device,
+BlurFilter::BlurFilter(ID3D12Device* device, GpuHeapAllocator* allocator,
     UINT width, UINT height,
     DXGI_FORMAT format)
 {
     md3dDevice = device;
+    mAllocator = allocator;
 
     mWidth = width;
     mHeight = height;
@@ -115,6 +116,11 @@ void BlurFilter::Execute(ID3D12GraphicsCommandList* cmdList,
             cmdList->ResourceBarrier(1, &toRW);
         }
     }
+
+    // The next Execute expects both maps in COMMON; the output is returned
+    // there by the caller once it has been read.
+    auto toCommon = CD3DX12_RESOURCE_BARRIER::Transition(mBlurMap1.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON);
+    cmdList->ResourceBarrier(1, &toCommon);
 }
 
 std::vector<float> BlurFilter::CalcGaussWeights(float sigma)
@@ -188,21 +194,6 @@ void BlurFilter::BuildResources()
     texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 
-    auto heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &heapProperty,
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_COMMON,
-        nullptr,
-        IID_PPV_ARGS(&mBlurMap0)));
-
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &heapProperty,
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_COMMON,
-        nullptr,
-        IID_PPV_ARGS(&mBlurMap1)));
+    mBlurMap0 = mAllocator->CreateResource(texDesc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+    mBlurMap1 = mAllocator->CreateResource(texDesc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
 }
\ No newline at end of file
@@ -1,17 +1,19 @@
 #pragma once
 #include "GraphicsUtil.h"
 #include "directx/d3dx12.h"
+#include "GpuHeapAllocator.h"
 class BlurFilter
 {
 public:
     // ʺ ̴   Է ؽó ũ ؾմϴ.
     // ũ ũⰡ Ǹ ٽ ؾմϴ.
-    BlurFilter(ID3D12Device* device,
+    BlurFilter(ID3D12Device* device, GpuHeapAllocator* allocator,
         UINT width, UINT height,
         DXGI_FORMAT format);
     BlurFilter(const BlurFilter& rhs) = delete;
     BlurFilter& operator=(const BlurFilter& rhs) = delete;
 
+    // In GENERIC_READ after Execute; the caller returns it to COMMON.
     ID3D12Resource* Output();
 
     void BuildDescriptors(
@@ -40,6 +42,7 @@ private:
     const int MaxBlurRadius = 5;
 
     ID3D12Device* md3dDevice = nullptr;
+    GpuHeapAllocator* mAllocator = nullptr;
 
     UINT mWidth = 0;
     UINT mHeight = 0;
@@ -57,6 +60,6 @@ private:
     CD3DX12_GPU_DESCRIPTOR_HANDLE mBlur1GpuSrv;
     CD3DX12_GPU_DESCRIPTOR_HANDLE mBlur1GpuUav;
 
-    Microsoft::WRL::ComPtr<ID3D12Resource> mBlurMap0 = nullptr;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mBlurMap1 = nullptr;
+    GpuResource mBlurMap0;
+    GpuResource mBlurMap1;
 };
\ No newline at end of file
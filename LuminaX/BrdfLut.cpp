@@ -0,0 +1,144 @@
+#include "BrdfLut.h"
+#include "ParallelFor.h"
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    constexpr UINT MinRowsPerThread = 4;
+
+    float RadicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    // Smith G1 with the Schlick-GGX k of image based lighting, alpha / 2.
+    XMVECTOR GeometrySchlick(FXMVECTOR NdotX, FXMVECTOR k)
+    {
+        return XMVectorDivide(NdotX, XMVectorMultiplyAdd(NdotX, XMVectorSubtract(g_XMOne, k), k));
+    }
+
+    // Scale and bias of four NdotV values at one roughness.
+    void Integrate(FXMVECTOR NdotV, const std::vector<XMFLOAT2>& halfVectors, float alpha,
+        XMVECTOR& scale, XMVECTOR& bias)
+    {
+        const XMVECTOR k = XMVectorReplicate(alpha * 0.5f);
+        const XMVECTOR sinV = XMVectorSqrt(XMVectorMax(XMVectorSubtract(g_XMOne, XMVectorMultiply(NdotV, NdotV)),
+            XMVectorZero()));
+        const XMVECTOR G1V = GeometrySchlick(NdotV, k);
+
+        scale = XMVectorZero();
+        bias = XMVectorZero();
+        for (const XMFLOAT2& h : halfVectors)
+        {
+            // The view is (sinV, 0, NdotV) and h = (x, ., z); l reflects it about h.
+            const XMVECTOR hx = XMVectorReplicate(h.x);
+            const XMVECTOR hz = XMVectorReplicate(h.y);
+            const XMVECTOR VdotH = XMVectorMultiplyAdd(sinV, hx, XMVectorMultiply(NdotV, hz));
+            const XMVECTOR NdotL = XMVectorSubtract(XMVectorScale(XMVectorMultiply(VdotH, hz), 2.0f), NdotV);
+            const XMVECTOR valid = XMVectorAndInt(XMVectorGreater(NdotL, XMVectorZero()),
+                XMVectorGreater(VdotH, XMVectorZero()));
+
+            const XMVECTOR G = XMVectorMultiply(G1V, GeometrySchlick(XMVectorMax(NdotL, XMVectorZero()), k));
+            const XMVECTOR visibility = XMVectorDivide(XMVectorMultiply(G, VdotH), XMVectorMultiply(hz, NdotV));
+
+            const XMVECTOR oneMinus = XMVectorSubtract(g_XMOne, XMVectorSaturate(VdotH));
+            const XMVECTOR oneMinus2 = XMVectorMultiply(oneMinus, oneMinus);
+            const XMVECTOR fresnel = XMVectorMultiply(XMVectorMultiply(oneMinus2, oneMinus2), oneMinus);
+
+            const XMVECTOR weighted = XMVectorSelect(XMVectorZero(), visibility, valid);
+            scale = XMVectorMultiplyAdd(XMVectorSubtract(g_XMOne, fresnel), weighted, scale);
+            bias = XMVectorMultiplyAdd(fresnel, weighted, bias);
+        }
+
+        const float inverseCount = 1.0f / halfVectors.size();
+        scale = XMVectorScale(scale, inverseCount);
+        bias = XMVectorScale(bias, inverseCount);
+    }
+}
+
+DXGI_FORMAT BrdfLut::Format(bool multiScatter)
+{
+    return multiScatter ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_R16G16_FLOAT;
+}
+
+void BrdfLut::Generate(UINT size, UINT sampleCount, bool multiScatter,
+    std::unique_ptr<uint8_t[]>& data, D3D12_SUBRESOURCE_DATA& level)
+{
+    const UINT texelSize = multiScatter ? sizeof(XMHALF4) : sizeof(XMHALF2);
+    data = std::make_unique<uint8_t[]>((size_t)size * size * texelSize);
+    level.pData = data.get();
+    level.RowPitch = (LONG_PTR)size * texelSize;
+    level.SlicePitch = level.RowPitch * size;
+
+    ParallelFor(size, MinRowsPerThread, [&](UINT begin, UINT end)
+    {
+        std::vector<XMFLOAT2> halfVectors;
+        std::vector<XMFLOAT2> row(size);
+        for (UINT y = begin; y < end; ++y)
+        {
+            const float roughness = (y + 0.5f) / size;
+            const float alpha = roughness * roughness;
+
+            // GGX distributed half vectors; only their x and z matter with the
+            // view in the xz plane.
+            halfVectors.clear();
+            for (UINT i = 0; i < sampleCount; ++i)
+            {
+                const float phi = 2.0f * XM_PI * (i + 0.5f) / sampleCount;
+                const float u = RadicalInverse(i);
+                const float cosTheta = std::sqrt((1.0f - u) / (1.0f + (alpha * alpha - 1.0f) * u));
+                const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+                halfVectors.push_back({ sinTheta * std::cos(phi), cosTheta });
+            }
+
+            for (UINT x = 0; x < size; x += 4)
+            {
+                // Lanes past the row repeat its last texel.
+                XMFLOAT4 NdotV;
+                NdotV.x = (std::min(x, size - 1) + 0.5f) / size;
+                NdotV.y = (std::min(x + 1, size - 1) + 0.5f) / size;
+                NdotV.z = (std::min(x + 2, size - 1) + 0.5f) / size;
+                NdotV.w = (std::min(x + 3, size - 1) + 0.5f) / size;
+
+                XMVECTOR scale, bias;
+                Integrate(XMLoadFloat4(&NdotV), halfVectors, alpha, scale, bias);
+
+                XMFLOAT4 scales, biases;
+                XMStoreFloat4(&scales, scale);
+                XMStoreFloat4(&biases, bias);
+                const float s[4] = { scales.x, scales.y, scales.z, scales.w };
+                const float b[4] = { biases.x, biases.y, biases.z, biases.w };
+                for (UINT lane = 0; lane < 4 && x + lane < size; ++lane)
+                    row[x + lane] = { s[lane], b[lane] };
+            }
+
+            // Cosine-weighted average of the directional albedo over NdotV.
+            float averageAlbedo = 0.0f;
+            for (UINT x = 0; x < size; ++x)
+                averageAlbedo += (row[x].x + row[x].y) * (x + 0.5f) / size;
+            averageAlbedo *= 2.0f / size;
+
+            uint8_t* dest = data.get() + level.RowPitch * y;
+            for (UINT x = 0; x < size; ++x)
+            {
+                if (multiScatter)
+                    XMStoreHalf4(reinterpret_cast<XMHALF4*>(dest) + x,
+                        XMVectorSet(row[x].x, row[x].y, averageAlbedo, 1.0f));
+                else
+                    XMStoreHalf2(reinterpret_cast<XMHALF2*>(dest) + x, XMVectorSet(row[x].x, row[x].y, 0.0f, 0.0f));
+            }
+        }
+    });
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <memory>
+
+// Generates the environment BRDF lookup table of the split-sum
+// approximation. Texel (x, y) is NdotV = (x + 0.5) / size and perceptual
+// roughness (y + 0.5) / size; red and green are the scale and bias the
+// prefiltered environment's F0 gets:
+//
+//     specular = prefiltered * (F0 * lut.r + lut.g)
+//
+// With multiScatter a blue channel holds the GGX lobe's cosine-weighted
+// average albedo for the row's roughness, which the shader needs for
+// multiple scattering energy compensation (Kulla and Conty). An RG table
+// reads 0 there, which leaves the compensation off.
+//
+// The integrals importance sample GGX with a Hammersley set. The half
+// vectors of a row don't depend on NdotV, so four texels of a row are
+// integrated at once, one per SIMD lane; rows are split across threads.
+class BrdfLut
+{
+public:
+    // Bumped whenever the table's contents change.
+    static constexpr uint32_t Version = 1;
+
+    // RG16F, or RGBA16F with the multiple scattering channel.
+    static DXGI_FORMAT Format(bool multiScatter);
+
+    // data receives the table and level points into it.
+    static void Generate(UINT size, UINT sampleCount, bool multiScatter,
+        std::unique_ptr<uint8_t[]>& data, D3D12_SUBRESOURCE_DATA& level);
+};
@@ -1,42 +1,169 @@
 #include "Buffers.h"
 #include "directx/d3dx12.h"
+#include "GraphicsUtil.h"
+#include <algorithm>
+#include <cassert>
+#include <emmintrin.h>
 using namespace Microsoft::WRL;
-Microsoft::WRL::ComPtr<ID3D12Resource> Buffers::CreateDefaultBuffer(
-	ID3D12Device* device,
-	ID3D12GraphicsCommandList* cmdList,
-	const void* initData,
-	UINT64 byteSize,
-	Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer
-)
+void Buffers::StreamingCopy(void* dest, size_t destSize, const void* src, size_t srcSize)
 {
-	ComPtr<ID3D12Resource> defaultBuffer;
-	auto properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(byteSize);
-	device->CreateCommittedResource(&properties, D3D12_HEAP_FLAG_NONE,
-		&bufferDesc, D3D12_RESOURCE_STATE_COMMON, nullptr,
-		IID_PPV_ARGS(defaultBuffer.GetAddressOf()));
+	assert(srcSize <= destSize);
 
-	//temp heap for init data
-	properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	device->CreateCommittedResource(&properties, D3D12_HEAP_FLAG_NONE,
-		&bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-		IID_PPV_ARGS(uploadBuffer.GetAddressOf()));
+	auto d = static_cast<BYTE*>(dest);
+	auto s = static_cast<const BYTE*>(src);
+	BYTE* end = d + destSize;
 
-	D3D12_SUBRESOURCE_DATA subResourceData;
-	subResourceData.pData = initData;
-	subResourceData.RowPitch = static_cast<LONG_PTR>(byteSize);
-	subResourceData.SlicePitch = subResourceData.RowPitch;
+	// Plain stores up to the first 16 byte boundary. memcpy/memset only write
+	// to the destination, so this is still safe for write-combined memory.
+	size_t head = std::min<size_t>((16 - (reinterpret_cast<uintptr_t>(d) & 15)) & 15, destSize);
+	size_t headCopy = std::min(head, srcSize);
+	memcpy(d, s, headCopy);
+	memset(d + headCopy, 0, head - headCopy);
+	d += head;
+	s += headCopy;
+	srcSize -= headCopy;
 
-	//barrier
-	auto commonToDest =CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-	cmdList->ResourceBarrier(1, &commonToDest);
+	while (srcSize >= 16 && end - d >= 16)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+		d += 16;
+		s += 16;
+		srcSize -= 16;
+	}
 
-	UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(),
-		0, 0, 1, &subResourceData);
+	// Last partial block of the source, padded with zeros.
+	if (srcSize > 0 && end - d >= 16)
+	{
+		alignas(16) BYTE block[16] = {};
+		memcpy(block, s, srcSize);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_load_si128(reinterpret_cast<const __m128i*>(block)));
+		d += 16;
+		srcSize = 0;
+	}
 
-	auto destToRead = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-	cmdList->ResourceBarrier(1, &destToRead);
+	const __m128i zero = _mm_setzero_si128();
+	while (end - d >= 16)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), zero);
+		d += 16;
+	}
 
-	return defaultBuffer;
+	size_t tail = end - d;
+	size_t tailCopy = std::min(tail, srcSize);
+	memcpy(d, s, tailCopy);
+	memset(d + tailCopy, 0, tail - tailCopy);
 }
 
+void Buffers::StreamingFence()
+{
+	// Make the streaming stores visible before the command list is submitted.
+	_mm_sfence();
+}
+
+LinearUploadAllocator::LinearUploadAllocator(ID3D12Device* device, UINT64 capacity)
+	: md3dDevice(device)
+{
+	CreateHeap(capacity);
+}
+
+LinearUploadAllocator::~LinearUploadAllocator()
+{
+	if (mHeap != nullptr)
+		mHeap->Unmap(0, nullptr);
+}
+
+UploadAllocation LinearUploadAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+	UINT64 head = mAllocated % mCapacity;
+	UINT64 offset = (head + alignment - 1) & ~(alignment - 1);
+	UINT64 padding = offset - head;
+
+	// Never split an allocation across the end of the ring.
+	if (offset + size > mCapacity)
+	{
+		padding = mCapacity - head;
+		offset = 0;
+	}
+
+	if (mAllocated + padding + size - mRetired > mCapacity)
+	{
+		// Out of space: switch to a larger heap. The old one stays alive until
+		// the GPU has consumed the frames that still reference it.
+		mHeap->Unmap(0, nullptr);
+		mRetiredHeaps.push_back({ 0, mHeap });
+		mPendingFrames.clear();
+
+		UINT64 newCapacity = mCapacity * 2;
+		while (newCapacity < size + alignment)
+			newCapacity *= 2;
+		CreateHeap(newCapacity);
+
+		return Allocate(size, alignment);
+	}
+
+	mAllocated += padding + size;
+
+	UploadAllocation alloc;
+	alloc.CPU = mMappedData + offset;
+	alloc.GPU = mHeap->GetGPUVirtualAddress() + offset;
+	alloc.Resource = mHeap.Get();
+	alloc.Offset = offset;
+	alloc.Size = size;
+	return alloc;
+}
+
+void LinearUploadAllocator::FinishFrame(UINT64 fenceValue)
+{
+	mPendingFrames.push_back({ fenceValue, mAllocated });
+
+	// Heaps replaced during this frame are released together with it.
+	for (auto& retired : mRetiredHeaps)
+	{
+		if (retired.Fence == 0)
+			retired.Fence = fenceValue;
+	}
+}
+
+void LinearUploadAllocator::Retire(UINT64 completedFenceValue)
+{
+	while (!mPendingFrames.empty() && mPendingFrames.front().Fence <= completedFenceValue)
+	{
+		mRetired = mPendingFrames.front().AllocatedEnd;
+		mPendingFrames.pop_front();
+	}
+
+	std::erase_if(mRetiredHeaps, [&](const RetiredHeap& retired)
+	{
+		return retired.Fence != 0 && retired.Fence <= completedFenceValue;
+	});
+}
+
+UINT64 LinearUploadAllocator::Capacity() const
+{
+	return mCapacity;
+}
+
+UINT64 LinearUploadAllocator::BytesInUse() const
+{
+	return mAllocated - mRetired;
+}
+
+void LinearUploadAllocator::CreateHeap(UINT64 capacity)
+{
+	mCapacity = capacity;
+	mAllocated = 0;
+	mRetired = 0;
+
+	auto heapProp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(capacity);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&heapProp,
+		D3D12_HEAP_FLAG_NONE,
+		&resourceDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mHeap)));
+
+	// Upload heaps may stay mapped for their whole lifetime.
+	ThrowIfFailed(mHeap->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+}
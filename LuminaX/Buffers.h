@@ -2,23 +2,27 @@
 #include<wrl.h>
 #include "directx/d3d12.h"
 #include "directx/d3dx12.h"
+#include <deque>
+#include <span>
+#include <vector>
+
+#include "GpuHeapAllocator.h"
 class Buffers
 {
 public:
-	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
-		ID3D12Device* device,
-		ID3D12GraphicsCommandList* cmdList,
-		const void* initData,
-		UINT64 byteSize,
-		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer
-	);
+	// Copies srcSize bytes into write-combined memory (upload heaps) with
+	// non-temporal stores and zero fills the rest of destSize, so whole lines
+	// are written and the destination is never read. End a batch of copies
+	// with StreamingFence.
+	static void StreamingCopy(void* dest, size_t destSize, const void* src, size_t srcSize);
+	static void StreamingFence();
 };
 
 template<typename T>
 class UploadBuffer
 {
 public:
-    UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer)
+    UploadBuffer(GpuHeapAllocator* allocator, UINT elementCount, bool isConstantBuffer)
         : mIsConstantBuffer(isConstantBuffer)
     {
         mElementByteSize = sizeof(T);
@@ -30,15 +34,8 @@ public:
         if (isConstantBuffer)
             mElementByteSize = (sizeof(T) + 255) & ~255;
 
-        auto heapProp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-        auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize * elementCount);
-        device->CreateCommittedResource(
-            &heapProp,
-            D3D12_HEAP_FLAG_NONE,
-            &resourceDesc,
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&mUploadBuffer));
+        mUploadBuffer = allocator->CreateBuffer((UINT64)mElementByteSize * elementCount,
+            D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ);
 
         mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData));
     }
@@ -64,10 +61,135 @@ public:
         memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
     }
 
+    // Writes count consecutive elements in one pass of streaming stores.
+    void CopyRange(UINT firstElement, const T* data, UINT count)
+    {
+        WriteRange(firstElement, data, count);
+        Buffers::StreamingFence();
+    }
+
+    // Writes data[i] to element indices[i]. Indices must be ascending; runs of
+    // consecutive indices are written as a single range.
+    void CopyElements(std::span<const UINT> indices, std::span<const T> data)
+    {
+        size_t first = 0;
+        for (size_t i = 1; i <= indices.size(); ++i)
+        {
+            if (i == indices.size() || indices[i] != indices[i - 1] + 1)
+            {
+                WriteRange(indices[first], &data[first], (UINT)(i - first));
+                first = i;
+            }
+        }
+        Buffers::StreamingFence();
+    }
+
+    UINT ElementByteSize() const
+    {
+        return mElementByteSize;
+    }
+
+private:
+    void WriteRange(UINT firstElement, const T* data, UINT count)
+    {
+        BYTE* dest = &mMappedData[(size_t)firstElement * mElementByteSize];
+        if (mElementByteSize == sizeof(T))
+        {
+            Buffers::StreamingCopy(dest, sizeof(T) * (size_t)count, data, sizeof(T) * (size_t)count);
+            return;
+        }
+
+        // Constant buffer slots are padded to 256 bytes; the padding is
+        // written as zeros so that every slot is covered completely.
+        for (UINT i = 0; i < count; ++i)
+            Buffers::StreamingCopy(dest + (size_t)i * mElementByteSize, mElementByteSize, &data[i], sizeof(T));
+    }
+
 private:
-    Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+    GpuResource mUploadBuffer;
     BYTE* mMappedData = nullptr;
 
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
+};
+
+struct UploadAllocation
+{
+    BYTE* CPU = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+    ID3D12Resource* Resource = nullptr;
+    UINT64 Offset = 0;
+    UINT64 Size = 0;
+};
+
+// Linear sub-allocator over one persistently mapped upload heap, used as a
+// ring. Handing out memory is a pointer bump; everything allocated during a
+// frame is reclaimed once the fence value passed to FinishFrame completes.
+// If a frame needs more than is free the heap is replaced by a larger one and
+// the old one is released when the GPU is done with it.
+class LinearUploadAllocator
+{
+public:
+    LinearUploadAllocator(ID3D12Device* device, UINT64 capacity);
+    ~LinearUploadAllocator();
+
+    LinearUploadAllocator(const LinearUploadAllocator& rhs) = delete;
+    LinearUploadAllocator& operator=(const LinearUploadAllocator& rhs) = delete;
+
+    UploadAllocation Allocate(UINT64 size, UINT64 alignment);
+
+    // 256 byte aligned range usable as a root CBV.
+    template<typename T>
+    UploadAllocation AllocateConstants(const T& data)
+    {
+        UploadAllocation alloc = Allocate(sizeof(T), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        memcpy(alloc.CPU, &data, sizeof(T));
+        return alloc;
+    }
+
+    // Range usable as a root SRV over a StructuredBuffer<T>.
+    template<typename T>
+    UploadAllocation AllocateStructured(const T* data, UINT count)
+    {
+        UploadAllocation alloc = Allocate(sizeof(T) * (UINT64)count, D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+        memcpy(alloc.CPU, data, sizeof(T) * (size_t)count);
+        return alloc;
+    }
+
+    // Closes the current frame; its allocations are freed once fenceValue completes.
+    void FinishFrame(UINT64 fenceValue);
+    // Frees the memory of every finished frame whose fence has completed.
+    void Retire(UINT64 completedFenceValue);
+
+    UINT64 Capacity() const;
+    UINT64 BytesInUse() const;
+
+private:
+    void CreateHeap(UINT64 capacity);
+
+private:
+    struct PendingFrame
+    {
+        UINT64 Fence;
+        UINT64 AllocatedEnd;
+    };
+
+    struct RetiredHeap
+    {
+        UINT64 Fence;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+    };
+
+    ID3D12Device* md3dDevice = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mHeap;
+    BYTE* mMappedData = nullptr;
+    UINT64 mCapacity = 0;
+
+    // Monotonic byte counters (alignment and wrap padding included); their
+    // difference is the amount of the ring still owned by the GPU.
+    UINT64 mAllocated = 0;
+    UINT64 mRetired = 0;
+
+    std::deque<PendingFrame> mPendingFrames;
+    std::vector<RetiredHeap> mRetiredHeaps;
 };
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "CubeMapScheduler.h"
+#include "Camera.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+CubeMapScheduler::CubeMapScheduler(uint32_t facesPerFrame)
+    : mFacesPerFrame(std::min(facesPerFrame, FaceCount))
+{
+}
+
+uint32_t CubeMapScheduler::FacesPerFrame() const
+{
+    return mFacesPerFrame;
+}
+
+void CubeMapScheduler::SetFacesPerFrame(uint32_t count)
+{
+    // Zero pauses the updates; the front cube keeps its last contents.
+    mFacesPerFrame = std::min(count, FaceCount);
+}
+
+void CubeMapScheduler::SetCameras(const Camera (&cameras)[FaceCount])
+{
+    for (uint32_t face = 0; face < FaceCount; ++face)
+    {
+        BoundingFrustum viewFrustum;
+        BoundingFrustum::CreateFromMatrix(viewFrustum, cameras[face].GetProj());
+        viewFrustum.Transform(mFrusta[face], XMMatrixInverse(nullptr, cameras[face].GetView()));
+    }
+
+    ClearItems();
+}
+
+void CubeMapScheduler::UpdateItem(size_t index, const BoundingSphere& worldBounds, uint32_t group)
+{
+    if (index >= mItems.size())
+        mItems.resize(index + 1);
+
+    FaceMask faces = 0;
+    for (uint32_t face = 0; face < FaceCount; ++face)
+    {
+        if (mFrusta[face].Intersects(worldBounds))
+            faces |= (FaceMask)(1 << face);
+    }
+
+    // The faces the item left show what was behind it now.
+    Invalidate(mItems[index].Faces | faces);
+
+    RemoveFromFaces((uint32_t)index);
+    Item& item = mItems[index];
+    item.Faces = faces;
+    item.Group = group;
+    if (group != NoGroup && group >= mGroupFaceCounts.size())
+        mGroupFaceCounts.resize(group + 1);
+    for (uint32_t face = 0; face < FaceCount; ++face)
+    {
+        if ((faces & (1 << face)) == 0)
+            continue;
+        item.Slots[face] = (uint32_t)mFaceItems[face].size();
+        mFaceItems[face].push_back((uint32_t)index);
+        if (group != NoGroup)
+            ++mGroupFaceCounts[group][face];
+    }
+}
+
+void CubeMapScheduler::RemoveFromFaces(uint32_t index)
+{
+    const Item& item = mItems[index];
+    for (uint32_t face = 0; face < FaceCount; ++face)
+    {
+        if ((item.Faces & (1 << face)) == 0)
+            continue;
+
+        // The last item of the list takes the removed one's place.
+        std::vector<uint32_t>& items = mFaceItems[face];
+        const uint32_t moved = items.back();
+        items[item.Slots[face]] = moved;
+        mItems[moved].Slots[face] = item.Slots[face];
+        items.pop_back();
+        if (item.Group != NoGroup)
+            --mGroupFaceCounts[item.Group][face];
+    }
+}
+
+void CubeMapScheduler::ClearItems()
+{
+    mItems.clear();
+    for (auto& items : mFaceItems)
+        items.clear();
+    mGroupFaceCounts.clear();
+    Invalidate(AllFaces);
+}
+
+CubeMapScheduler::FaceMask CubeMapScheduler::ItemFaces(size_t index) const
+{
+    return index < mItems.size() ? mItems[index].Faces : 0;
+}
+
+CubeMapScheduler::FaceMask CubeMapScheduler::GroupFaces(uint32_t group) const
+{
+    if (group >= mGroupFaceCounts.size())
+        return 0;
+
+    FaceMask faces = 0;
+    for (uint32_t face = 0; face < FaceCount; ++face)
+    {
+        if (mGroupFaceCounts[group][face] != 0)
+            faces |= (FaceMask)(1 << face);
+    }
+    return faces;
+}
+
+const std::vector<uint32_t>& CubeMapScheduler::FaceItems(uint32_t face) const
+{
+    return mFaceItems[face];
+}
+
+void CubeMapScheduler::Invalidate(FaceMask faces)
+{
+    mStale |= faces;
+}
+
+CubeMapScheduler::FaceMask CubeMapScheduler::BeginFrame()
+{
+    // An update takes the faces that are out of date when it starts; faces
+    // that go stale meanwhile wait for the next one.
+    if (mPending == 0)
+        mPending = mStale;
+
+    // Lowest faces first, so an update walks the faces in order.
+    FaceMask faces = 0;
+    for (uint32_t i = 0; i < mFacesPerFrame && mPending != 0; ++i)
+    {
+        const FaceMask face = mPending & (FaceMask)(~mPending + 1);
+        faces |= face;
+        mPending &= (FaceMask)~face;
+    }
+    mStale &= (FaceMask)~faces;
+    return faces;
+}
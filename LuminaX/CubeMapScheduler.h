@@ -0,0 +1,87 @@
+#pragma once
+#include <DirectXCollision.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Camera;
+
+// Spreads the updates of a dynamic cube map over frames and keeps them to
+// the faces whose contents changed.
+//
+// Dirty detection: the scheduler remembers which face frusta every item
+// overlapped when it was last reported. An item that moves dirties the faces
+// it left as well as the ones it entered; other faces stay untouched. Items
+// also belong to a group, such as their material, and per group and face
+// the scheduler counts the items, so a change to a group finds its faces
+// without visiting the items.
+//
+// Updates: at most FacesPerFrame faces are redrawn per frame, in place.
+// The faces that were out of date when an update started are all drawn
+// before the ones that changed since, so a face that changes every frame
+// can't hold the others back. The cube has a single buffer: nothing samples
+// it while the faces are drawn, so a half updated cube is never seen.
+//
+// Per frame the app calls BeginFrame and draws the faces it returns.
+class CubeMapScheduler
+{
+public:
+    static constexpr uint32_t FaceCount = 6;
+
+    // Bit i stands for face i, in CubeMapFace order.
+    using FaceMask = uint8_t;
+    static constexpr FaceMask AllFaces = (1 << FaceCount) - 1;
+
+    explicit CubeMapScheduler(uint32_t facesPerFrame = 1);
+
+    uint32_t FacesPerFrame() const;
+    void SetFacesPerFrame(uint32_t count);
+
+    // Takes the face frusta from the cube's cameras. Every face becomes
+    // dirty and the items have to be reported again.
+    void SetCameras(const Camera (&cameras)[FaceCount]);
+
+    static constexpr uint32_t NoGroup = ~0u;
+
+    // Reports the world bounds and the group of item index after it was
+    // added or changed.
+    void UpdateItem(size_t index, const DirectX::BoundingSphere& worldBounds, uint32_t group = NoGroup);
+    // Forgets every item, for a scene that is rebuilt.
+    void ClearItems();
+    // Faces item index was last seen in.
+    FaceMask ItemFaces(size_t index) const;
+    // Faces any item of group was last seen in.
+    FaceMask GroupFaces(uint32_t group) const;
+    // Indices of the items last seen in face, in no particular order.
+    const std::vector<uint32_t>& FaceItems(uint32_t face) const;
+
+    // For changes that aren't tied to an item's bounds, such as a material;
+    // GroupFaces gives the faces of the items that use it.
+    void Invalidate(FaceMask faces = AllFaces);
+
+    // Faces to draw this frame.
+    FaceMask BeginFrame();
+
+private:
+    struct Item
+    {
+        FaceMask Faces = 0;
+        uint32_t Group = NoGroup;
+        // Position of the item in each of its faces' lists.
+        uint32_t Slots[FaceCount] = {};
+    };
+
+    void RemoveFromFaces(uint32_t index);
+
+    uint32_t mFacesPerFrame = 1;
+    DirectX::BoundingFrustum mFrusta[FaceCount];
+    std::vector<Item> mItems;
+    std::vector<uint32_t> mFaceItems[FaceCount];
+    std::vector<std::array<uint32_t, FaceCount>> mGroupFaceCounts;
+
+    // Faces that are out of date, and those of the current update that are
+    // still to be drawn.
+    FaceMask mStale = AllFaces;
+    FaceMask mPending = 0;
+};
@@ -2,8 +2,8 @@
 #include "Application.h"
 #include "GraphicsUtil.h"
 
-CubeRenderTarget::CubeRenderTarget(ID3D12Device* device, UINT width, UINT height, DXGI_FORMAT format)
-    :md3dDevice(device), mWidth(width), mHeight(height), mFormat(format)
+CubeRenderTarget::CubeRenderTarget(ID3D12Device* device, GpuHeapAllocator* allocator, UINT width, UINT height, DXGI_FORMAT format)
+    :md3dDevice(device), mAllocator(allocator), mWidth(width), mHeight(height), mFormat(format)
 {
     mViewport = { 0.f, 0.f, (float)width, (float)height, 0.f, 1.f };
     mScissorRect = { 0, 0, (LONG)width, (LONG)height };
@@ -108,12 +108,7 @@ void CubeRenderTarget::BuildResource()
     texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
 
-    auto heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &heapProperty,
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&mCubeMap)));
+    // Placed render targets start with undefined contents; every face is
+    // cleared before it is drawn, which also initializes the memory.
+    mCubeMap = mAllocator->CreateResource(texDesc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "GraphicsUtil.h"
+#include "GpuHeapAllocator.h"
 
 enum class CubeMapFace : int
 {
@@ -14,7 +15,7 @@ enum class CubeMapFace : int
 class CubeRenderTarget
 {
 public:
-    CubeRenderTarget(ID3D12Device* device,
+    CubeRenderTarget(ID3D12Device* device, GpuHeapAllocator* allocator,
         UINT width, UINT height,
         DXGI_FORMAT format);
 
@@ -42,6 +43,7 @@ private:
 
 private:
     ID3D12Device* md3dDevice = nullptr;
+    GpuHeapAllocator* mAllocator = nullptr;
 
     D3D12_VIEWPORT mViewport;
     D3D12_RECT mScissorRect;
@@ -54,5 +56,5 @@ private:
     CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
     CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtv[6];
 
-    Microsoft::WRL::ComPtr<ID3D12Resource> mCubeMap = nullptr;
+    GpuResource mCubeMap;
 };
\ No newline at end of file
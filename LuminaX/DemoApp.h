@@ -6,11 +6,31 @@
 #include <array>
 #include "Buffers.h"
 #include "FrameResource.h"
+#include "UploadManager.h"
+#include "AsyncTextureLoader.h"
 #include "GraphicsUtil.h"
 #include "BlurFilter.h"
 #include "Camera.h"
+#include "CubeMapScheduler.h"
 #include "CubeRenderTarget.h"
+#include "LodSelector.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "ShaderPermutations.h"
+#include "SphericalHarmonics.h"
+#include "FrameProfiler.h"
+#include <chrono>
+#include <fstream>
 struct MeshGeometry;
+class EnvironmentMap;
+struct IblBakeData;
+
+enum class RenderLayer : int
+{
+	Opaque = 0,
+	Sky,
+	Count
+};
 
 struct RenderItem
 {
@@ -25,12 +45,9 @@ struct RenderItem
 
     DirectX::XMFLOAT4X4 TexTransform = GraphicsUtil::Identity4x4();
 
-    // Ʈ Ͱ  Ÿ Ƽ ÷Դϴ.
-    // Ƽ ÷װ ȰȭǾ   ۸ Ʈ  մϴ.
-    //   ڿ Ʈ  ۰ ϱ 
-    // Ʈ Ͱ  NumFramesDirty = gNumFrameResource
-    // ؾմϴ. ̷ ϹǷν   ҽ Ʈ ˴ϴ.
-    int NumFramesDirty = 3;//gNumFrameResources;
+    // Object constants are uploaded from the frame resources' dirty sets, so
+    // changes to World, TexTransform or Mat must be reported with
+    // DemoApp::MarkObjectDirty.
 
     //  ۿ شϴ ü   ε Դϴ.
     UINT ObjCBIndex = -1;
@@ -45,6 +62,20 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+    // Local-space bounds of LOD 0, used to compute the projected size.
+    DirectX::BoundingSphere Bounds;
+
+    // LOD chain ordered from finest to coarsest. The selected LOD is copied
+    // into the DrawIndexedInstance parameters above.
+    std::array<SubmeshGeometry, LodSelector::MaxLodCount> Lods;
+    UINT LodCount = 0;
+    UINT CurrLod = 0;
+
+    // Set when the item covers too few pixels to be worth drawing.
+    bool Culled = false;
+
+    RenderLayer Layer = RenderLayer::Opaque;
 };
 
 struct ObjectConstants
@@ -86,6 +117,9 @@ struct PassConstants
 	// indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
 	// are spot lights for a maximum of MaxLights per object.
 	Light Lights[MaxLights];
+
+	// Diffuse light of the sky, see SphericalHarmonics.
+	DirectX::XMFLOAT4 IrradianceSH[SphericalHarmonics::CoefficientCount] = {};
 };
 
 
@@ -105,11 +139,55 @@ struct MaterialData
 };
 
 
+// Procedurally generated scene used to measure how the renderer scales.
+struct StressSceneDesc
+{
+	// Number of render items to generate, not counting the sky.
+	UINT ItemCount = 0;
+
+	// Fraction of the items that move; 0 gives a fully static scene.
+	float AnimatedFraction = 0.0f;
+
+	// Fraction of the animated items whose transform is rewritten every frame.
+	float DirtyRate = 1.0f;
+
+	float Spacing = 3.0f;
+	UINT Seed = 1;
+};
+
+struct BenchmarkSettings
+{
+	bool Enabled = false;
+
+	// Stress scene sizes to step through. Each step runs WarmupFrames before
+	// averaging the stage timings over MeasureFrames.
+	std::vector<UINT> ItemCounts = { 1000, 10000, 100000, 1000000 };
+	UINT WarmupFrames = 60;
+	UINT MeasureFrames = 300;
+
+	std::wstring ReportFileName = L"./benchmark.csv";
+
+	// Upload bandwidth micro benchmark (-uploadbench), runs once at startup
+	// and compares the ways of writing object constants.
+	bool UploadBandwidth = false;
+	UINT UploadElementCount = 100000;
+	UINT UploadIterations = 20;
+	std::wstring UploadReportFileName = L"./upload_benchmark.csv";
+};
+
 class DemoApp :public Application
 {
 public:
 	virtual bool Init(HINSTANCE hinstance) override;
 
+	// -stress <count> -animated <fraction> -dirty <fraction> -benchmark
+	// -cubefaces <dynamic cube map faces drawn per frame>
+	void ParseCommandLine(const std::string& cmdLine);
+
+	// -pack writes the asset pack from the loose assets instead of running.
+	bool PackRequested() const { return mPackAssets; }
+	bool PackAssets() const;
+
 private:
 	virtual void OnResize() override;
 	virtual void Update() override;
@@ -118,10 +196,22 @@ private:
 	virtual void OnMouseDown(WPARAM btnState, int x, int y) override;
 	virtual void OnMouseUp(WPARAM btnState, int x, int y) override;
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) override;
+	virtual void OnKeyDown(WPARAM key) override;
 
 	virtual bool CreateRtvAndDsvDescHeap() override;
 
-	void LoadTextures();
+	// Returns the sky's decoded levels for the environment bake, or null if
+	// it failed to load.
+	std::unique_ptr<DecodedTexture> LoadTextures();
+	// Publishes textures that finished loading to their materials.
+	void ApplyTextureResults(std::vector<TextureLoadResult>& results);
+	// Requests the mips the visible items need and publishes streaming changes.
+	void UpdateTextureStreaming();
+	// Rewrites the view of tex and points its materials at it.
+	void PublishTexture(Texture& tex);
+	void CreateTextureSrv(const Texture& tex);
+	// SRV index a material should use for tex right now.
+	int TextureSrvIndex(const Texture* tex) const;
 	void UpdateCamera();
 	void UpdateObjectCBs();
 	void UpdateMaterialBuffer();
@@ -136,55 +226,197 @@ private:
 	void BuildCubeDepthStencil();
 	void BuildRootSignature();
 	void BuildPostProcessRootSignature();
+	// Compiles run as tasks; ShaderBytecode waits for the one it names.
 	void BuildShaderAndInputLayout();
+	D3D12_SHADER_BYTECODE ShaderBytecode(const std::string& name) const;
+	static D3D12_SHADER_BYTECODE ShaderBytecode(ID3DBlob* blob);
     void BuildShapeGeometry();
     void BuildPSO();
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
+	void AddRenderItem(RenderLayer layer, const std::string& submeshName, Material* mat, DirectX::FXMMATRIX world);
+	void SetRenderItemGeometry(RenderItem* ritem, const std::string& submeshName);
+	// Re-reads the draw parameters of every submesh and render item after the
+	// geometry pool moved its contents.
+	void RefreshGeometryRanges();
+	void BuildRenderLayers();
+	void BuildMaterialTable();
+
+	// Schedule re-uploads in every frame resource. Must be called whenever a
+	// render item or material changes after it was created.
+	void MarkObjectDirty(UINT objCBIndex);
+	void MarkMaterialDirty(UINT matCBIndex);
+	void MarkSceneDirty();
+	// Tells mCubeMapScheduler where the item is and which material it uses.
+	void ReportCubeMapItem(const RenderItem& ritem);
+
+	bool LoadScene(const std::wstring& fileName);
+	bool SaveScene(const std::wstring& fileName);
+
+	void BuildStressRenderItems(const StressSceneDesc& desc);
+	void AnimateStressItems();
+
+	void UpdateBenchmark();
+	void RunUploadBenchmark();
+
+	// Waits for the GPU and recreates the frame resources for a new count.
+	void SetFramesInFlight(UINT count);
+	void UpdateFrameStats();
 
 	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, ID3D12Resource* objectCB = nullptr);
-	void BakeIrradianceMap();
+	// Draws the dynamic cube map faces the scheduler picked for this frame.
+	void DrawDynamicCubeMap();
+	// Sets up the image based lighting of the sky: the irradiance SH in the
+	// pass constants, the prefiltered specular map and the BRDF lookup
+	// table. They are read from the IBL cache, or baked from sky and cached.
+	void BakeEnvironmentLighting(const DecodedTexture* sky);
+	void BakeIrradianceMap(const EnvironmentMap& environment, DirectX::XMFLOAT4* coefficients);
+	void ApplyEnvironmentLighting(const IblBakeData& bake);
 
 
 private:
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
 	FrameResource* mCurrFrameResource = nullptr;
-	//to be used for baking 
-	std::unique_ptr<FrameResource> mGeneralFrameResource;
+
 	int mCurrFrameResourceIndex = 0;
 
 	PassConstants mMainPassCB;
+	D3D12_GPU_VIRTUAL_ADDRESS mMainPassCBAddress = 0;
+
+	// Transient per frame data (pass constants, ...) is sub-allocated from here.
+	std::unique_ptr<LinearUploadAllocator> mUploadAllocator;
+	const UINT64 UploadRingSize = 1 << 20;
+
+	// Static resource uploads (textures, geometry) go through the copy queue.
+	std::unique_ptr<UploadManager> mUploadManager;
+	const UINT64 StagingArenaSize = 32ull << 20;
+
+	// Vertices and indices of all meshes; grows on demand.
+	std::unique_ptr<GeometryPool> mGeometryPool;
+	UINT64 mGeometryPoolVersion = 0;
+	const UINT GeometryPoolVertexCapacity = 1 << 18;
+	const UINT GeometryPoolIndexCapacity = 1 << 20;
+	// The pool is compacted when its free space is split up more than this,
+	// checked every GeometryDefragmentInterval frames.
+	const double GeometryPoolMaxFragmentation = 0.5;
+	const UINT GeometryDefragmentInterval = 300;
+	UINT mFramesSinceDefragment = 0;
 	UINT mPassCbvOffset = 0;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mGeneralDescHeap;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSig;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mmDynamicCubeMapRootSig;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mPostProcessRootSignature;
+	// Serialized root signatures, part of the pipeline cache keys.
+	Microsoft::WRL::ComPtr<ID3DBlob> mRootSigBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mPostProcessRootSigBlob;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
-
-	enum class RenderLayer : int
-	{
-		Opaque = 0,
-		Sky,
-		Count
-	};
+	// All render items, stored contiguously. An item's index is its ObjCBIndex.
+	std::vector<RenderItem> mAllRitems;
+	// Scratch for UpdateObjectCBs, kept to avoid reallocating every frame.
+	std::vector<UINT> mDirtyObjectIndices;
+	std::vector<ObjectConstants> mDirtyObjectConstants;
 
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Opaque items that survived LOD selection this frame.
+	LodSelector mLodSelector;
+	std::vector<RenderItem*> mVisibleRitems;
+
+	StressSceneDesc mStressDesc;
+	// Indices into mAllRitems of the animated stress items and their rest positions.
+	std::vector<UINT> mAnimatedRitems;
+	std::vector<DirectX::XMFLOAT3> mAnimatedBasePositions;
+	size_t mAnimationCursor = 0;
+	std::chrono::steady_clock::time_point mStartTime = std::chrono::steady_clock::now();
+
+	FrameProfiler mProfiler;
+	BenchmarkSettings mBenchmark;
+	size_t mBenchmarkStep = 0;
+	UINT mBenchmarkFrame = 0;
+	std::ofstream mBenchmarkReport;
+	std::chrono::steady_clock::time_point mLastStatsUpdate;
+
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
+	// mMaterials indexed by MatCBIndex.
+	std::vector<Material*> mMaterialsByIndex;
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPSOs;
-	std::unique_ptr<CubeRenderTarget> mDynamicCubeMap = nullptr;
+	int mFallbackTexHeapIndex = -1;
+	int mSkyTexHeapIndex = -1;
+
+	// Textures are read and decoded on worker threads.
+	std::unique_ptr<AsyncTextureLoader> mTextureLoader;
+	std::unordered_map<uint32_t, Texture*> mTextureTickets;
+	std::vector<TextureLoadResult> mTextureResults;
+	const size_t TextureQueueBytes = 64ull << 20;
+	const size_t TextureUploadBytesPerFrame = 16ull << 20;
+
+	// Mips of 2D textures are streamed against this budget when the device
+	// supports tiled resources; otherwise textures are fully resident.
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::unordered_map<uint32_t, Texture*> mStreamedTextures;
+	std::vector<uint32_t> mStreamChanges;
+	const UINT64 TextureStreamingBudget = 256ull << 20;
+	std::unordered_map<std::string, std::shared_future<Microsoft::WRL::ComPtr<ID3DBlob>>> mShaders;
+	std::unique_ptr<PipelineCache> mPipelineCache;
+
+	// Features of the opaque pipeline, bits of its permutation key. The
+	// low bits are brdf.hlsl's features, the others select pipeline state.
+	enum OpaqueFeature : uint32_t
+	{
+		OpaqueImageBasedLighting = 1 << 0,
+		OpaqueWireframe = 1 << 1,
+		OpaqueFeatureCount = 2,
+		OpaqueShaderFeatures = OpaqueImageBasedLighting,
+	};
+	using PipelinePermutations = PermutationTable<Microsoft::WRL::ComPtr<ID3D12PipelineState>>;
+
+	std::unique_ptr<ShaderPermutations> mBrdfVS;
+	std::unique_ptr<ShaderPermutations> mBrdfPS;
+	std::unique_ptr<ShaderPermutations> mBlurHorzCS;
+	std::unique_ptr<ShaderPermutations> mBlurVertCS;
+	// Declared after the shaders and the cache their creates use.
+	std::unique_ptr<PipelinePermutations> mOpaquePipelines;
+	std::unique_ptr<PipelinePermutations> mBlurHorzPipeline;
+	std::unique_ptr<PipelinePermutations> mBlurVertPipeline;
+	uint32_t mOpaqueFeatures = OpaqueImageBasedLighting;
+	uint32_t mDrawnOpaqueFeatures = OpaqueImageBasedLighting;
+	bool mBlurEnabled = false;
+
+	PipelineRegistry mPSOs;
+	const std::wstring PipelineCacheFileName = L"./Assets/Cache/Pipelines.bin";
+	// mCubeMapScheduler picks the faces of the dynamic cube map redrawn per frame.
+	std::unique_ptr<CubeRenderTarget> mDynamicCubeMap;
 	int mDynamicTexHeapIndex = -1;
+	CubeMapScheduler mCubeMapScheduler;
+	std::vector<RenderItem*> mCubeFaceRitems;
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mCubeDSV;
-	Microsoft::WRL::ComPtr<ID3D12Resource> mCubeDepthStencilBuffer;
+	GpuResource mCubeDepthStencilBuffer;
 	const UINT CubeMapSize = 512;
+	// Face size the sky is reduced to for the irradiance bake; nine
+	// coefficients don't see any detail below it.
+	const UINT IrradianceBakeSize = 64;
+	// The prefiltered specular map, with a full chain from this size down.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mSpecularMap;
+	const UINT SpecularMapSize = 256;
+	const UINT SpecularSampleCount = 256;
+	// Split-sum BRDF lookup table. It isn't committed: the first run
+	// generates it into the texture cache, keyed by these settings.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mBrdfLut;
+	const UINT BrdfLutSize = 128;
+	const UINT BrdfLutSampleCount = 1024;
+	const bool BrdfLutMultiScatter = true;
+	const std::wstring SceneFileName = L"./Assets/Scenes/demo.lxscene";
+	// Bumped whenever BuildMaterials or BuildRenderItems changes, so the
+	// scene baked from them is built again.
+	const uint32_t DemoSceneVersion = 1;
+	const std::wstring AssetDirectory = L"./Assets";
+	const std::wstring AssetPackFileName = L"./Assets.lxpack";
+	bool mPackAssets = false;
 
 	std::unique_ptr<BlurFilter> mBlurFilter;
 
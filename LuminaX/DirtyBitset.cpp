@@ -0,0 +1,59 @@
+#include "DirtyBitset.h"
+
+void DirtyBitset::Resize(size_t count)
+{
+    // Drop bits past the new end so ForEach never reports them.
+    if (count < mSize)
+    {
+        for (size_t i = count; i < mSize && i % 64 != 0; ++i)
+            mWords[i / 64] &= ~(uint64_t(1) << (i % 64));
+
+        size_t wordCount = (count + 63) / 64;
+        std::erase_if(mDirtyWords, [&](uint32_t wordIndex)
+        {
+            return wordIndex >= wordCount || mWords[wordIndex] == 0;
+        });
+    }
+
+    mWords.resize((count + 63) / 64, 0);
+    mSize = count;
+}
+
+size_t DirtyBitset::Size() const
+{
+    return mSize;
+}
+
+void DirtyBitset::Set(size_t index)
+{
+    uint64_t& word = mWords[index / 64];
+    if (word == 0)
+        mDirtyWords.push_back((uint32_t)(index / 64));
+    word |= uint64_t(1) << (index % 64);
+}
+
+void DirtyBitset::SetAll()
+{
+    if (mSize == 0)
+        return;
+
+    std::fill(mWords.begin(), mWords.end(), ~uint64_t(0));
+    if (mSize % 64 != 0)
+        mWords.back() = (uint64_t(1) << (mSize % 64)) - 1;
+
+    mDirtyWords.resize(mWords.size());
+    for (size_t i = 0; i < mWords.size(); ++i)
+        mDirtyWords[i] = (uint32_t)i;
+}
+
+void DirtyBitset::Clear()
+{
+    for (uint32_t wordIndex : mDirtyWords)
+        mWords[wordIndex] = 0;
+    mDirtyWords.clear();
+}
+
+bool DirtyBitset::Any() const
+{
+    return !mDirtyWords.empty();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Set of changed element indices. Besides one bit per element it remembers
+// which 64 bit words hold any set bit, so that visiting and clearing the set
+// costs time proportional to the changes rather than to the element count.
+class DirtyBitset
+{
+public:
+    // Keeps the existing bits; new elements start out clean.
+    void Resize(size_t count);
+    size_t Size() const;
+
+    void Set(size_t index);
+    void SetAll();
+    void Clear();
+
+    bool Any() const;
+
+    // Calls fn(index) for every set bit in ascending order.
+    template<typename Fn>
+    void ForEach(Fn&& fn)
+    {
+        // The word list is short compared to the element count; sorting it
+        // keeps the visit order ascending, which lets uploads coalesce.
+        std::sort(mDirtyWords.begin(), mDirtyWords.end());
+
+        for (uint32_t wordIndex : mDirtyWords)
+        {
+            uint64_t word = mWords[wordIndex];
+            while (word != 0)
+            {
+                // countr_zero compiles to tzcnt/bsf.
+                size_t bit = (size_t)std::countr_zero(word);
+                fn((size_t)wordIndex * 64 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> mWords;
+    std::vector<uint32_t> mDirtyWords;
+    size_t mSize = 0;
+};
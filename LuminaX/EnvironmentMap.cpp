@@ -0,0 +1,386 @@
+#include "EnvironmentMap.h"
+#include "ParallelFor.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    enum class TexelType
+    {
+        RGBA8,
+        RGBA8Srgb,
+        BGRA8,
+        BGRA8Srgb,
+        BGRX8,
+        RGB10A2,
+        RGBA16F,
+        RGB32F,
+        RGBA32F,
+        RG11B10F,
+        RGB9E5,
+        BC1,
+        BC1Srgb,
+        BC3,
+        BC3Srgb,
+        Unsupported
+    };
+
+    TexelType TypeOf(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_R8G8B8A8_UNORM: return TexelType::RGBA8;
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return TexelType::RGBA8Srgb;
+        case DXGI_FORMAT_B8G8R8A8_UNORM: return TexelType::BGRA8;
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: return TexelType::BGRA8Srgb;
+        case DXGI_FORMAT_B8G8R8X8_UNORM: return TexelType::BGRX8;
+        case DXGI_FORMAT_R10G10B10A2_UNORM: return TexelType::RGB10A2;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT: return TexelType::RGBA16F;
+        case DXGI_FORMAT_R32G32B32_FLOAT: return TexelType::RGB32F;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT: return TexelType::RGBA32F;
+        case DXGI_FORMAT_R11G11B10_FLOAT: return TexelType::RG11B10F;
+        case DXGI_FORMAT_R9G9B9E5_SHAREDEXP: return TexelType::RGB9E5;
+        case DXGI_FORMAT_BC1_UNORM: return TexelType::BC1;
+        case DXGI_FORMAT_BC1_UNORM_SRGB: return TexelType::BC1Srgb;
+        case DXGI_FORMAT_BC3_UNORM: return TexelType::BC3;
+        case DXGI_FORMAT_BC3_UNORM_SRGB: return TexelType::BC3Srgb;
+        default: return TexelType::Unsupported;
+        }
+    }
+
+    bool IsBlockCompressed(TexelType type)
+    {
+        return type == TexelType::BC1 || type == TexelType::BC1Srgb ||
+            type == TexelType::BC3 || type == TexelType::BC3Srgb;
+    }
+
+    bool IsSrgb(TexelType type)
+    {
+        return type == TexelType::RGBA8Srgb || type == TexelType::BGRA8Srgb ||
+            type == TexelType::BC1Srgb || type == TexelType::BC3Srgb;
+    }
+
+    // Face rows per thread below which work runs on fewer threads.
+    constexpr UINT MinRowsPerThread = 16;
+
+    XMVECTOR DecodeTexel(TexelType type, const uint8_t* row, UINT x)
+    {
+        switch (type)
+        {
+        case TexelType::RGBA8:
+        case TexelType::RGBA8Srgb:
+            return XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(row) + x);
+        case TexelType::BGRA8:
+        case TexelType::BGRA8Srgb:
+            return XMVectorSwizzle<2, 1, 0, 3>(XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(row) + x));
+        case TexelType::BGRX8:
+            return XMVectorSetW(XMVectorSwizzle<2, 1, 0, 3>(
+                XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(row) + x)), 1.0f);
+        case TexelType::RGB10A2:
+            return XMLoadUDecN4(reinterpret_cast<const XMUDECN4*>(row) + x);
+        case TexelType::RGBA16F:
+            return XMLoadHalf4(reinterpret_cast<const XMHALF4*>(row) + x);
+        case TexelType::RGB32F:
+            return XMVectorSetW(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(row) + x), 1.0f);
+        case TexelType::RG11B10F:
+            return XMVectorSetW(XMLoadFloat3PK(reinterpret_cast<const XMFLOAT3PK*>(row) + x), 1.0f);
+        case TexelType::RGB9E5:
+            return XMVectorSetW(XMLoadFloat3SE(reinterpret_cast<const XMFLOAT3SE*>(row) + x), 1.0f);
+        default:
+            return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row) + x);
+        }
+    }
+
+    XMVECTOR Unpack565(uint16_t c)
+    {
+        return XMVectorSet(((c >> 11) & 31) / 31.0f, ((c >> 5) & 63) / 63.0f, (c & 31) / 31.0f, 1.0f);
+    }
+
+    // Decodes the BC1 color block of a 4x4 block into texels, alpha untouched
+    // unless the block uses BC1's transparent index.
+    void DecodeColorBlock(const uint8_t* block, bool allowTransparent, XMVECTOR texels[16])
+    {
+        uint16_t c0, c1;
+        uint32_t indices;
+        std::memcpy(&c0, block, 2);
+        std::memcpy(&c1, block + 2, 2);
+        std::memcpy(&indices, block + 4, 4);
+
+        XMVECTOR palette[4];
+        palette[0] = Unpack565(c0);
+        palette[1] = Unpack565(c1);
+        if (c0 > c1 || !allowTransparent)
+        {
+            palette[2] = XMVectorLerp(palette[0], palette[1], 1.0f / 3.0f);
+            palette[3] = XMVectorLerp(palette[0], palette[1], 2.0f / 3.0f);
+        }
+        else
+        {
+            palette[2] = XMVectorLerp(palette[0], palette[1], 0.5f);
+            palette[3] = XMVectorZero();
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const XMVECTOR color = palette[(indices >> (2 * i)) & 3];
+            texels[i] = allowTransparent ? color : XMVectorSelect(texels[i], color, g_XMSelect1110);
+        }
+    }
+
+    void DecodeAlphaBlock(const uint8_t* block, XMVECTOR texels[16])
+    {
+        float palette[8];
+        palette[0] = block[0] / 255.0f;
+        palette[1] = block[1] / 255.0f;
+        if (block[0] > block[1])
+        {
+            for (int i = 1; i < 7; ++i)
+                palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7.0f;
+        }
+        else
+        {
+            for (int i = 1; i < 5; ++i)
+                palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5.0f;
+            palette[6] = 0.0f;
+            palette[7] = 1.0f;
+        }
+
+        uint64_t indices = 0;
+        std::memcpy(&indices, block + 2, 6);
+        for (int i = 0; i < 16; ++i)
+            texels[i] = XMVectorSetW(texels[i], palette[(indices >> (3 * i)) & 7]);
+    }
+
+    // Decodes one face level of size texels square into dest.
+    void DecodeFace(TexelType type, const D3D12_SUBRESOURCE_DATA& source, UINT size, XMFLOAT4A* dest)
+    {
+        const uint8_t* src = static_cast<const uint8_t*>(source.pData);
+        const bool srgb = IsSrgb(type);
+        if (!IsBlockCompressed(type))
+        {
+            for (UINT y = 0; y < size; ++y)
+            {
+                const uint8_t* row = src + source.RowPitch * y;
+                for (UINT x = 0; x < size; ++x)
+                {
+                    XMVECTOR texel = DecodeTexel(type, row, x);
+                    XMStoreFloat4A(&dest[(size_t)size * y + x], srgb ? XMColorSRGBToRGB(texel) : texel);
+                }
+            }
+            return;
+        }
+
+        // Levels smaller than a block still take a whole one.
+        const bool bc1 = type == TexelType::BC1 || type == TexelType::BC1Srgb;
+        const UINT blockSize = bc1 ? 8 : 16;
+        const UINT blocks = (size + 3) / 4;
+        for (UINT by = 0; by < blocks; ++by)
+        {
+            const uint8_t* row = src + source.RowPitch * by;
+            for (UINT bx = 0; bx < blocks; ++bx)
+            {
+                const uint8_t* block = row + (size_t)blockSize * bx;
+                XMVECTOR texels[16] = {};
+                if (bc1)
+                    DecodeColorBlock(block, true, texels);
+                else
+                {
+                    DecodeAlphaBlock(block, texels);
+                    DecodeColorBlock(block + 8, false, texels);
+                }
+
+                for (UINT i = 0; i < 16; ++i)
+                {
+                    const UINT x = bx * 4 + i % 4;
+                    const UINT y = by * 4 + i / 4;
+                    if (x < size && y < size)
+                        XMStoreFloat4A(&dest[(size_t)size * y + x], srgb ? XMColorSRGBToRGB(texels[i]) : texels[i]);
+                }
+            }
+        }
+    }
+
+    // 2x2 box filter; odd sizes drop the last row and column.
+    void Downsample(const std::vector<XMFLOAT4A>& src, UINT srcSize, std::vector<XMFLOAT4A>& dest)
+    {
+        const UINT size = std::max(srcSize / 2, 1u);
+        dest.resize((size_t)size * size * 6);
+        ParallelFor(size * 6, MinRowsPerThread, [&](UINT begin, UINT end)
+        {
+            for (UINT faceRow = begin; faceRow < end; ++faceRow)
+            {
+                const UINT face = faceRow / size;
+                const UINT y = faceRow % size;
+                const XMFLOAT4A* srcFace = &src[(size_t)srcSize * srcSize * face];
+                const XMFLOAT4A* row0 = srcFace + (size_t)srcSize * std::min(2 * y, srcSize - 1);
+                const XMFLOAT4A* row1 = srcFace + (size_t)srcSize * std::min(2 * y + 1, srcSize - 1);
+                XMFLOAT4A* destRow = &dest[(size_t)size * size * face + (size_t)size * y];
+                for (UINT x = 0; x < size; ++x)
+                {
+                    const UINT x0 = std::min(2 * x, srcSize - 1);
+                    const UINT x1 = std::min(2 * x + 1, srcSize - 1);
+                    XMVECTOR sum = XMVectorAdd(XMLoadFloat4A(&row0[x0]), XMLoadFloat4A(&row0[x1]));
+                    sum = XMVectorAdd(sum, XMVectorAdd(XMLoadFloat4A(&row1[x0]), XMLoadFloat4A(&row1[x1])));
+                    XMStoreFloat4A(&destRow[x], XMVectorScale(sum, 0.25f));
+                }
+            }
+        });
+    }
+
+    float AreaElement(float x, float y)
+    {
+        return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+    }
+}
+
+bool EnvironmentMap::IsSupported(DXGI_FORMAT format)
+{
+    return TypeOf(format) != TexelType::Unsupported;
+}
+
+bool EnvironmentMap::Load(DXGI_FORMAT format, UINT size, UINT mipLevels,
+    const std::vector<D3D12_SUBRESOURCE_DATA>& subresources, UINT maxSize)
+{
+    const TexelType type = TypeOf(format);
+    if (type == TexelType::Unsupported || size == 0 || mipLevels == 0 || subresources.size() < 6 * (size_t)mipLevels)
+        return false;
+
+    UINT first = 0;
+    while (first + 1 < mipLevels && (size >> first) > maxSize)
+        ++first;
+    UINT levelSize = std::max(size >> first, 1u);
+
+    mLevels.clear();
+    mLevels.emplace_back((size_t)levelSize * levelSize * 6);
+    ParallelFor(6, 1, [&](UINT begin, UINT end)
+    {
+        for (UINT face = begin; face < end; ++face)
+            DecodeFace(type, subresources[(size_t)face * mipLevels + first], levelSize,
+                &mLevels[0][(size_t)levelSize * levelSize * face]);
+    });
+
+    // A source without small enough levels is filtered down first.
+    while (levelSize > std::max(maxSize, 1u))
+    {
+        std::vector<XMFLOAT4A> level;
+        Downsample(mLevels[0], levelSize, level);
+        mLevels[0] = std::move(level);
+        levelSize = std::max(levelSize / 2, 1u);
+    }
+    mSize = levelSize;
+
+    while (levelSize > 1)
+    {
+        mLevels.emplace_back();
+        Downsample(mLevels[mLevels.size() - 2], levelSize, mLevels.back());
+        levelSize /= 2;
+    }
+    return true;
+}
+
+UINT EnvironmentMap::MipLevels() const
+{
+    return (UINT)mLevels.size();
+}
+
+UINT EnvironmentMap::Size(UINT level) const
+{
+    return std::max(mSize >> level, 1u);
+}
+
+const XMFLOAT4A* EnvironmentMap::Face(UINT level, UINT face) const
+{
+    const size_t faceSize = mLevels[level].size() / 6;
+    return &mLevels[level][faceSize * face];
+}
+
+XMVECTOR EnvironmentMap::Sample(FXMVECTOR direction, float level) const
+{
+    // Face and face coordinates of the major axis, inverting Direction.
+    XMFLOAT3 d;
+    XMStoreFloat3(&d, direction);
+    const float ax = std::fabs(d.x);
+    const float ay = std::fabs(d.y);
+    const float az = std::fabs(d.z);
+    UINT face;
+    float u, v;
+    if (ax >= ay && ax >= az)
+    {
+        face = d.x > 0.0f ? 0 : 1;
+        u = (d.x > 0.0f ? -d.z : d.z) / ax;
+        v = -d.y / ax;
+    }
+    else if (ay >= az)
+    {
+        face = d.y > 0.0f ? 2 : 3;
+        u = d.x / ay;
+        v = (d.y > 0.0f ? d.z : -d.z) / ay;
+    }
+    else
+    {
+        face = d.z > 0.0f ? 4 : 5;
+        u = (d.z > 0.0f ? d.x : -d.x) / az;
+        v = -d.y / az;
+    }
+
+    auto bilinear = [&](UINT mip)
+    {
+        const UINT size = Size(mip);
+        const XMFLOAT4A* texels = Face(mip, face);
+        const float s = std::clamp((u + 1.0f) * 0.5f * size - 0.5f, 0.0f, size - 1.0f);
+        const float t = std::clamp((v + 1.0f) * 0.5f * size - 0.5f, 0.0f, size - 1.0f);
+        const UINT x0 = (UINT)s;
+        const UINT y0 = (UINT)t;
+        const UINT x1 = std::min(x0 + 1, size - 1);
+        const UINT y1 = std::min(y0 + 1, size - 1);
+        const float fx = s - x0;
+        const float fy = t - y0;
+        const XMVECTOR top = XMVectorLerp(XMLoadFloat4A(&texels[(size_t)size * y0 + x0]),
+            XMLoadFloat4A(&texels[(size_t)size * y0 + x1]), fx);
+        const XMVECTOR bottom = XMVectorLerp(XMLoadFloat4A(&texels[(size_t)size * y1 + x0]),
+            XMLoadFloat4A(&texels[(size_t)size * y1 + x1]), fx);
+        return XMVectorLerp(top, bottom, fy);
+    };
+
+    level = std::clamp(level, 0.0f, (float)(MipLevels() - 1));
+    const UINT mip = (UINT)level;
+    const float blend = level - mip;
+    if (blend == 0.0f)
+        return bilinear(mip);
+    return XMVectorLerp(bilinear(mip), bilinear(mip + 1), blend);
+}
+
+XMVECTOR EnvironmentMap::Direction(UINT face, float u, float v)
+{
+    switch (face)
+    {
+    case 0: return XMVectorSet(1.0f, -v, -u, 0.0f);
+    case 1: return XMVectorSet(-1.0f, -v, u, 0.0f);
+    case 2: return XMVectorSet(u, 1.0f, v, 0.0f);
+    case 3: return XMVectorSet(u, -1.0f, -v, 0.0f);
+    case 4: return XMVectorSet(u, -v, 1.0f, 0.0f);
+    default: return XMVectorSet(-u, -v, -1.0f, 0.0f);
+    }
+}
+
+XMVECTOR EnvironmentMap::TexelDirection(UINT face, UINT x, UINT y, UINT size)
+{
+    const float scale = 2.0f / size;
+    return Direction(face, (x + 0.5f) * scale - 1.0f, (y + 0.5f) * scale - 1.0f);
+}
+
+float EnvironmentMap::TexelSolidAngle(UINT x, UINT y, UINT size)
+{
+    // Integral of the projected area between the texel's corners.
+    const float scale = 2.0f / size;
+    const float x0 = x * scale - 1.0f;
+    const float y0 = y * scale - 1.0f;
+    const float x1 = x0 + scale;
+    const float y1 = y0 + scale;
+    return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+}
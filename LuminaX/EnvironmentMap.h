@@ -0,0 +1,52 @@
+#pragma once
+#include <DirectXMath.h>
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <vector>
+
+// A CPU copy of a cube map as linear float texels, the input of the image
+// based lighting bakes.
+//
+// Only one level of the source is decoded, the first one no larger than the
+// size asked for; the rest of the chain is box filtered from it, so a source
+// without mips works the same. 8 bit sRGB formats are converted to linear.
+// Face rows are decoded and filtered in parallel.
+class EnvironmentMap
+{
+public:
+    // Bumped when decoding or filtering changes the texels the bakes see.
+    static constexpr uint32_t Version = 1;
+
+    // RGBA8/BGRA8 (UNORM and UNORM_SRGB), BGRX8, RGB10A2, RGBA16F, RGB32F,
+    // RGBA32F, R11G11B10F, RGB9E5 and BC1/BC3 (UNORM and UNORM_SRGB).
+    static bool IsSupported(DXGI_FORMAT format);
+
+    // subresources are the faces of a cube map texture, face major as D3D12
+    // orders them, each with mipLevels levels of which the first is size
+    // texels square. False if the format isn't supported.
+    bool Load(DXGI_FORMAT format, UINT size, UINT mipLevels,
+        const std::vector<D3D12_SUBRESOURCE_DATA>& subresources, UINT maxSize);
+
+    UINT MipLevels() const;
+    UINT Size(UINT level) const;
+    // Size(level) squared texels, row by row.
+    const DirectX::XMFLOAT4A* Face(UINT level, UINT face) const;
+
+    // Trilinear lookup along direction, which needn't be normalized. Texels
+    // are filtered within a face only, with its edges clamped.
+    DirectX::XMVECTOR Sample(DirectX::FXMVECTOR direction, float level) const;
+
+    // Unnormalized direction through face coordinates u, v in [-1, 1], with
+    // v pointing down the face as texture rows do.
+    static DirectX::XMVECTOR Direction(UINT face, float u, float v);
+    // Direction through the center of texel x, y of a face size texels square.
+    static DirectX::XMVECTOR TexelDirection(UINT face, UINT x, UINT y, UINT size);
+    // Solid angle the texel covers; all texels of a cube add up to 4 pi.
+    static float TexelSolidAngle(UINT x, UINT y, UINT size);
+
+private:
+    // Each level holds the six faces one after another.
+    std::vector<std::vector<DirectX::XMFLOAT4A>> mLevels;
+    // Size of level 0.
+    UINT mSize = 0;
+};
@@ -0,0 +1,47 @@
+#include "FileUtil.h"
+#include <filesystem>
+#include <thread>
+
+uint64_t FileUtil::Hash(const void* data, size_t size, uint64_t hash)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool FileUtil::WriteAtomically(const std::wstring& fileName, const std::function<void(std::ofstream&)>& write)
+{
+    std::error_code error;
+    const std::filesystem::path path(fileName);
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path(), error);
+
+    std::filesystem::path temp = path;
+    temp += L"." + std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id())) + L".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        // Closing flushes, so it can fail as well.
+        write(file);
+        file.close();
+        if (!file)
+        {
+            std::filesystem::remove(temp, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+// File helpers shared by the on-disk caches and the asset pack.
+class FileUtil
+{
+public:
+    static constexpr uint64_t HashBasis = 14695981039346656037ull;
+
+    // FNV-1a, 64 bit. Passing a previous result as hash continues it, so
+    // several pieces can be hashed as one.
+    static uint64_t Hash(const void* data, size_t size, uint64_t hash = HashBasis);
+
+    // Creates the file's directory, lets write fill a temporary file next
+    // to it and then moves that into place. Threads writing the same file
+    // each use their own temporary, and a crash while writing leaves the
+    // previous file intact. Returns false, and leaves no temporary behind,
+    // if the stream failed or the move did.
+    static bool WriteAtomically(const std::wstring& fileName, const std::function<void(std::ofstream&)>& write);
+};
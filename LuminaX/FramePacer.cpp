@@ -0,0 +1,297 @@
+#include "FramePacer.h"
+#include "directx/d3dx12.h"
+#include "GraphicsUtil.h"
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    double ToMs(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+}
+
+FenceEventPool::~FenceEventPool()
+{
+    for (HANDLE event : mFreeEvents)
+        CloseHandle(event);
+}
+
+void FenceEventPool::Wait(ID3D12Fence* fence, UINT64 value)
+{
+    if (fence->GetCompletedValue() >= value)
+        return;
+
+    // Auto-reset events: a finished wait leaves the event unsignaled, ready for reuse.
+    HANDLE event = Acquire();
+    ThrowIfFailed(fence->SetEventOnCompletion(value, event));
+    WaitForSingleObject(event, INFINITE);
+    Release(event);
+}
+
+HANDLE FenceEventPool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFreeEvents.empty())
+        return CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+
+    HANDLE event = mFreeEvents.back();
+    mFreeEvents.pop_back();
+    return event;
+}
+
+void FenceEventPool::Release(HANDLE event)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFreeEvents.push_back(event);
+}
+
+FramePacer::FramePacer()
+{
+    // High resolution timers (Windows 10 1803+) wake up within a fraction of a
+    // millisecond instead of the default timer resolution.
+    mTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (mTimer == nullptr)
+        mTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+}
+
+FramePacer::~FramePacer()
+{
+    if (mQueryReadback != nullptr)
+        mQueryReadback->Unmap(0, nullptr);
+    if (mTimer != nullptr)
+        CloseHandle(mTimer);
+}
+
+void FramePacer::Init(ID3D12Device* device, ID3D12CommandQueue* queue, ID3D12Fence* fence)
+{
+    mFence = fence;
+
+    if (FAILED(queue->GetTimestampFrequency(&mTimestampFrequency)))
+        return;
+
+    D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+    queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    queryHeapDesc.Count = QuerySlotCount * 2;
+    ThrowIfFailed(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+    auto heapProp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * QuerySlotCount * 2);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &heapProp,
+        D3D12_HEAP_FLAG_NONE,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&mQueryReadback)));
+
+    void* mapped = nullptr;
+    ThrowIfFailed(mQueryReadback->Map(0, nullptr, &mapped));
+    mTimestamps = static_cast<const UINT64*>(mapped);
+}
+
+void FramePacer::SetFramesInFlight(UINT count)
+{
+    mFramesInFlight = std::clamp(count, 1u, MaxFramesInFlight);
+}
+
+UINT FramePacer::FramesInFlight() const
+{
+    return mFramesInFlight;
+}
+
+void FramePacer::SetTargetFps(double fps)
+{
+    mTargetFps = std::max(fps, 0.0);
+    mNextFrameDue = {};
+}
+
+double FramePacer::TargetFps() const
+{
+    return mTargetFps;
+}
+
+void FramePacer::Throttle()
+{
+    mLimiterMs = 0.0;
+    if (mTargetFps <= 0.0)
+        return;
+
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / mTargetFps));
+    auto now = Clock::now();
+
+    // After a hitch start over instead of rushing frames out to catch up.
+    if (mNextFrameDue == Clock::time_point{} || now > mNextFrameDue + period)
+        mNextFrameDue = now;
+
+    if (now < mNextFrameDue)
+    {
+        SleepUntil(mNextFrameDue);
+        mLimiterMs = ToMs(Clock::now() - now);
+    }
+    mNextFrameDue += period;
+}
+
+void FramePacer::WaitForFence(UINT64 value)
+{
+    mEventPool.Wait(mFence, value);
+}
+
+void FramePacer::BeginFrame(UINT64 frameResourceFence)
+{
+    auto now = Clock::now();
+
+    mCurrent = {};
+    mCurrent.QuerySlot = (UINT)(mFrameNumber++ % QuerySlotCount);
+    if (mLastFrameStart != Clock::time_point{})
+        mCurrent.Stats.FrameMs = ToMs(now - mLastFrameStart);
+    mLastFrameStart = now;
+    mCurrent.Stats.LimiterMs = mLimiterMs;
+
+    if (frameResourceFence != 0 && mFence->GetCompletedValue() < frameResourceFence)
+    {
+        WaitForFence(frameResourceFence);
+        mCurrent.Stats.CpuWaitMs = ToMs(Clock::now() - now);
+    }
+
+    // Input that arrived up to now is what this frame reacts to.
+    if (mHasPendingInput)
+    {
+        mCurrent.Stats.HasInput = true;
+        mFrameInput = mPendingInput;
+        mHasPendingInput = false;
+    }
+
+    CollectCompletedFrames();
+}
+
+void FramePacer::BeginGpuFrame(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mQueryHeap == nullptr)
+        return;
+    cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mCurrent.QuerySlot * 2);
+}
+
+void FramePacer::EndGpuFrame(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mQueryHeap == nullptr)
+        return;
+    UINT first = mCurrent.QuerySlot * 2;
+    cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first + 1);
+    cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, 2,
+        mQueryReadback.Get(), sizeof(UINT64) * first);
+    mCurrent.HasTimestamps = true;
+}
+
+void FramePacer::OnPresent(UINT64 fenceValue)
+{
+    // Present returning is as close to the display as the CPU can observe
+    // without a waitable swap chain.
+    if (mCurrent.Stats.HasInput)
+        mCurrent.Stats.InputToPresentMs = ToMs(Clock::now() - mFrameInput);
+
+    mCurrent.Fence = fenceValue;
+    mInFlight.push_back(mCurrent);
+}
+
+void FramePacer::OnInput()
+{
+    if (!mHasPendingInput)
+    {
+        mPendingInput = Clock::now();
+        mHasPendingInput = true;
+    }
+}
+
+const std::deque<FramePacer::FrameStats>& FramePacer::History() const
+{
+    return mHistory;
+}
+
+FramePacer::FrameStats FramePacer::Average() const
+{
+    FrameStats average;
+    UINT inputFrames = 0;
+    for (const auto& stats : mHistory)
+    {
+        average.FrameMs += stats.FrameMs;
+        average.CpuWaitMs += stats.CpuWaitMs;
+        average.LimiterMs += stats.LimiterMs;
+        average.GpuBusyMs += stats.GpuBusyMs;
+        average.GpuWaitMs += stats.GpuWaitMs;
+        if (stats.HasInput)
+        {
+            average.InputToPresentMs += stats.InputToPresentMs;
+            inputFrames++;
+        }
+    }
+
+    if (!mHistory.empty())
+    {
+        double count = (double)mHistory.size();
+        average.FrameMs /= count;
+        average.CpuWaitMs /= count;
+        average.LimiterMs /= count;
+        average.GpuBusyMs /= count;
+        average.GpuWaitMs /= count;
+    }
+    if (inputFrames > 0)
+    {
+        average.InputToPresentMs /= inputFrames;
+        average.HasInput = true;
+    }
+    return average;
+}
+
+void FramePacer::ResetHistory()
+{
+    mHistory.clear();
+}
+
+void FramePacer::CollectCompletedFrames()
+{
+    UINT64 completed = mFence->GetCompletedValue();
+    while (!mInFlight.empty() && mInFlight.front().Fence <= completed)
+    {
+        InFlightFrame& frame = mInFlight.front();
+        if (frame.HasTimestamps && mTimestampFrequency != 0)
+        {
+            UINT64 begin = mTimestamps[frame.QuerySlot * 2];
+            UINT64 end = mTimestamps[frame.QuerySlot * 2 + 1];
+            double msPerTick = 1000.0 / (double)mTimestampFrequency;
+
+            frame.Stats.GpuBusyMs = (double)(end - begin) * msPerTick;
+            if (mLastGpuEnd != 0 && begin > mLastGpuEnd)
+                frame.Stats.GpuWaitMs = (double)(begin - mLastGpuEnd) * msPerTick;
+            mLastGpuEnd = end;
+        }
+
+        mHistory.push_back(frame.Stats);
+        if (mHistory.size() > MaxHistory)
+            mHistory.pop_front();
+        mInFlight.pop_front();
+    }
+}
+
+void FramePacer::SleepUntil(Clock::time_point time)
+{
+    // Let the timer cover most of the wait and spin the last stretch, which
+    // absorbs the wake up jitter of the scheduler.
+    const auto spinMargin = std::chrono::microseconds(500);
+
+    auto remaining = time - Clock::now();
+    if (mTimer != nullptr && remaining > spinMargin)
+    {
+        LARGE_INTEGER dueTime;
+        // Relative time in 100ns units.
+        dueTime.QuadPart = -(LONGLONG)std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10000000>>>(
+            remaining - spinMargin).count();
+        if (SetWaitableTimerEx(mTimer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+            WaitForSingleObject(mTimer, INFINITE);
+    }
+
+    while (Clock::now() < time)
+        YieldProcessor();
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <Windows.h>
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Hands out auto-reset events for fence waits so that waiting does not create
+// and destroy a kernel object every time. Safe to use from several threads.
+class FenceEventPool
+{
+public:
+    FenceEventPool() = default;
+    ~FenceEventPool();
+
+    FenceEventPool(const FenceEventPool& rhs) = delete;
+    FenceEventPool& operator=(const FenceEventPool& rhs) = delete;
+
+    // Blocks until fence reaches value.
+    void Wait(ID3D12Fence* fence, UINT64 value);
+
+private:
+    HANDLE Acquire();
+    void Release(HANDLE event);
+
+private:
+    std::mutex mMutex;
+    std::vector<HANDLE> mFreeEvents;
+};
+
+// Controls how far the CPU may run ahead of the GPU and how often frames are
+// started, and measures what that costs in latency.
+//
+// Per frame the app calls:
+//   Throttle()          before updating, sleeps if a target rate is set
+//   BeginFrame(fence)   waits until the frame resource about to be reused is free
+//   BeginGpuFrame/EndGpuFrame around the recorded commands (GPU timestamps)
+//   OnPresent(fence)    after Present and Signal
+// and OnInput() whenever an input message arrives.
+class FramePacer
+{
+public:
+    static constexpr UINT MaxFramesInFlight = 6;
+
+    struct FrameStats
+    {
+        double FrameMs = 0.0;           // CPU time since the previous frame began
+        double CpuWaitMs = 0.0;         // CPU blocked on the GPU to release a frame resource
+        double LimiterMs = 0.0;         // CPU sleeping in the frame limiter
+        double GpuBusyMs = 0.0;         // GPU time between the frame's first and last command
+        double GpuWaitMs = 0.0;         // GPU idle since the previous frame (starved by the CPU)
+        double InputToPresentMs = 0.0;  // oldest input handled by the frame until Present returned
+        bool HasInput = false;
+    };
+
+    FramePacer();
+    ~FramePacer();
+
+    FramePacer(const FramePacer& rhs) = delete;
+    FramePacer& operator=(const FramePacer& rhs) = delete;
+
+    void Init(ID3D12Device* device, ID3D12CommandQueue* queue, ID3D12Fence* fence);
+
+    // Clamped to [1, MaxFramesInFlight]. The owner has to resize its frame
+    // resources to match.
+    void SetFramesInFlight(UINT count);
+    UINT FramesInFlight() const;
+
+    // 0 disables the limiter.
+    void SetTargetFps(double fps);
+    double TargetFps() const;
+
+    void Throttle();
+    void WaitForFence(UINT64 value);
+
+    void BeginFrame(UINT64 frameResourceFence);
+    void BeginGpuFrame(ID3D12GraphicsCommandList* cmdList);
+    void EndGpuFrame(ID3D12GraphicsCommandList* cmdList);
+    void OnPresent(UINT64 fenceValue);
+    void OnInput();
+
+    // Frames whose GPU work has completed, oldest first.
+    const std::deque<FrameStats>& History() const;
+    FrameStats Average() const;
+    void ResetHistory();
+
+private:
+    void CollectCompletedFrames();
+    void SleepUntil(std::chrono::steady_clock::time_point time);
+
+private:
+    static constexpr UINT QuerySlotCount = MaxFramesInFlight + 2;
+    static constexpr size_t MaxHistory = 600;
+
+    struct InFlightFrame
+    {
+        UINT64 Fence = 0;
+        UINT QuerySlot = 0;
+        bool HasTimestamps = false;
+        FrameStats Stats;
+    };
+
+    ID3D12Fence* mFence = nullptr;
+    FenceEventPool mEventPool;
+    HANDLE mTimer = nullptr;
+
+    UINT mFramesInFlight = 3;
+    double mTargetFps = 0.0;
+
+    Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mQueryReadback;
+    const UINT64* mTimestamps = nullptr;
+    UINT64 mTimestampFrequency = 0;
+    UINT64 mLastGpuEnd = 0;
+
+    UINT64 mFrameNumber = 0;
+    InFlightFrame mCurrent;
+    std::deque<InFlightFrame> mInFlight;
+    std::deque<FrameStats> mHistory;
+
+    std::chrono::steady_clock::time_point mLastFrameStart;
+    std::chrono::steady_clock::time_point mNextFrameDue;
+    std::chrono::steady_clock::time_point mPendingInput;
+    std::chrono::steady_clock::time_point mFrameInput;
+    bool mHasPendingInput = false;
+    double mLimiterMs = 0.0;
+};
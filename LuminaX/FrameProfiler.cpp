@@ -0,0 +1,63 @@
+#include "FrameProfiler.h"
+
+using Clock = std::chrono::steady_clock;
+
+FrameProfiler::Scope::Scope(FrameProfiler& profiler, Stage stage)
+    : mProfiler(profiler), mStage(stage), mStart(Clock::now())
+{
+}
+
+FrameProfiler::Scope::~Scope()
+{
+    mProfiler.Add(mStage, Clock::now() - mStart);
+}
+
+void FrameProfiler::Reset()
+{
+    mTotals.fill(Clock::duration::zero());
+    mFrameCount = 0;
+    mWindowStart = Clock::now();
+}
+
+void FrameProfiler::EndFrame()
+{
+    mFrameCount++;
+}
+
+void FrameProfiler::Add(Stage stage, Clock::duration duration)
+{
+    mTotals[(int)stage] += duration;
+}
+
+unsigned FrameProfiler::FrameCount() const
+{
+    return mFrameCount;
+}
+
+double FrameProfiler::AverageMs(Stage stage) const
+{
+    if (mFrameCount == 0)
+        return 0.0;
+    return std::chrono::duration<double, std::milli>(mTotals[(int)stage]).count() / mFrameCount;
+}
+
+double FrameProfiler::AverageFrameMs() const
+{
+    if (mFrameCount == 0)
+        return 0.0;
+    return std::chrono::duration<double, std::milli>(Clock::now() - mWindowStart).count() / mFrameCount;
+}
+
+const char* FrameProfiler::StageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Update: return "update";
+    case Stage::Cull:   return "cull";
+    case Stage::Wait:   return "wait";
+    case Stage::Upload: return "upload";
+    case Stage::Record: return "record";
+    case Stage::Submit: return "submit";
+    default:            return "unknown";
+    }
+}
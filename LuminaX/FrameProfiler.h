@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <chrono>
+
+// Accumulates CPU time spent in each stage of a frame so that averages can
+// be reported over a measurement window.
+class FrameProfiler
+{
+public:
+    enum class Stage : int
+    {
+        Update = 0,  // camera and scene animation
+        Cull,        // LOD selection and culling
+        Wait,        // blocked on the GPU to release a frame resource
+        Upload,      // writing constant and material buffers
+        Record,      // recording the command list
+        Submit,      // execute and present
+        Count
+    };
+
+    class Scope
+    {
+    public:
+        Scope(FrameProfiler& profiler, Stage stage);
+        ~Scope();
+
+        Scope(const Scope& rhs) = delete;
+        Scope& operator=(const Scope& rhs) = delete;
+
+    private:
+        FrameProfiler& mProfiler;
+        Stage mStage;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    void Reset();
+    void EndFrame();
+
+    void Add(Stage stage, std::chrono::steady_clock::duration duration);
+
+    unsigned FrameCount() const;
+    // Average milliseconds per frame spent in a stage since the last Reset.
+    double AverageMs(Stage stage) const;
+    double AverageFrameMs() const;
+
+    static const char* StageName(Stage stage);
+
+private:
+    std::array<std::chrono::steady_clock::duration, (int)Stage::Count> mTotals = {};
+    std::chrono::steady_clock::time_point mWindowStart = std::chrono::steady_clock::now();
+    unsigned mFrameCount = 0;
+};
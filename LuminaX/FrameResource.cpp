@@ -1,11 +1,49 @@
 #include"FrameResource.h"
 #include"DemoApp.h"
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+#include <algorithm>
+FrameResource::FrameResource(ID3D12Device* device, GpuHeapAllocator* allocator, UINT passCount, UINT objectCount, UINT materialCount)
 {
 	device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(CmdListAlloc.GetAddressOf()));
 
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+	// Per frame pass constants may come from the upload ring instead.
+	if (passCount > 0)
+		PassCB = std::make_unique<UploadBuffer<PassConstants>>(allocator, passCount, true);
 
-	MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
+	EnsureCapacity(allocator, objectCount, materialCount);
+}
+
+void FrameResource::EnsureCapacity(GpuHeapAllocator* allocator, UINT objectCount, UINT materialCount)
+{
+	DirtyObjects.Resize(objectCount);
+	DirtyMaterials.Resize(materialCount);
+
+	// Grow geometrically so that adding items one at a time stays cheap.
+	if (objectCount > ObjectCapacity || ObjectCB == nullptr)
+	{
+		ObjectCapacity = std::max({ objectCount, ObjectCapacity + ObjectCapacity / 2, 1u });
+		ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(allocator, ObjectCapacity, true);
+		DirtyObjects.SetAll();
+	}
+
+	if (materialCount > MaterialCapacity || MaterialBuffer == nullptr)
+	{
+		MaterialCapacity = std::max({ materialCount, MaterialCapacity + MaterialCapacity / 2, 1u });
+		MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(allocator, MaterialCapacity, false);
+		DirtyMaterials.SetAll();
+	}
+}
+
+void FrameResource::MarkObjectDirty(UINT index)
+{
+	// Items can be added before the next EnsureCapacity call.
+	if (index >= DirtyObjects.Size())
+		DirtyObjects.Resize((size_t)index + 1);
+	DirtyObjects.Set(index);
+}
+
+void FrameResource::MarkMaterialDirty(UINT index)
+{
+	if (index >= DirtyMaterials.Size())
+		DirtyMaterials.Resize((size_t)index + 1);
+	DirtyMaterials.Set(index);
 }
@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "Buffers.h"
+#include "DirtyBitset.h"
 
 
 struct PassConstants;
@@ -13,10 +14,17 @@ struct MaterialData;
 class FrameResource
 {
 public:
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+	FrameResource(ID3D12Device* device, GpuHeapAllocator* allocator, UINT passCount, UINT objectCount, UINT materialCount);
 	FrameResource(const FrameResource& right) = delete;
 	FrameResource& operator=(const FrameResource& right) = delete;
 
+	// Reallocates the object/material buffers when they are too small and sizes
+	// the dirty sets to the counts. Must only be called once the GPU is done with
+	// this frame resource. Replaced buffers are marked entirely dirty.
+	void EnsureCapacity(GpuHeapAllocator* allocator, UINT objectCount, UINT materialCount);
+
+	void MarkObjectDirty(UINT index);
+	void MarkMaterialDirty(UINT index);
 
 	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 	std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
@@ -25,4 +33,11 @@ public:
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
 	UINT64 Fence = 0;
+
+	UINT ObjectCapacity = 0;
+	UINT MaterialCapacity = 0;
+
+	// Elements whose buffer contents in this frame resource are out of date.
+	DirtyBitset DirtyObjects;
+	DirtyBitset DirtyMaterials;
 };
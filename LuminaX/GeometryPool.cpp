@@ -0,0 +1,230 @@
+#include "GeometryPool.h"
+#include "UploadManager.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+GeometryPool::GeometryPool(GpuHeapAllocator* allocator, UploadManager* uploader,
+    UINT vertexByteStride, UINT vertexCapacity, UINT indexCapacity)
+    : mAllocator(allocator), mUploader(uploader), mVertexByteStride(vertexByteStride)
+{
+    Rebuild(vertexCapacity, indexCapacity);
+}
+
+uint32_t GeometryPool::Add(const void* vertices, UINT vertexCount, const uint32_t* indices, UINT indexCount)
+{
+    uint32_t id;
+    if (!mFreeIds.empty())
+    {
+        id = mFreeIds.back();
+        mFreeIds.pop_back();
+    }
+    else
+    {
+        id = (uint32_t)mEntries.size();
+        mEntries.emplace_back();
+    }
+
+    Entry& entry = mEntries[id];
+    entry = Entry();
+    entry.Range.VertexCount = vertexCount;
+    entry.Range.IndexCount = indexCount;
+
+    if (!Place(entry))
+    {
+        // Out of space: rebuild into larger buffers, which also packs the
+        // existing geometry. Only the buffer that is too small grows.
+        UINT vertexCapacity = mVertexCapacity;
+        if (mVertexRanges->GetStats().LargestFreeBlock < vertexCount)
+            vertexCapacity = std::max(mVertexCapacity * 2, mVertexCapacity + vertexCount);
+
+        UINT indexCapacity = mIndexCapacity;
+        if (mIndexRanges->GetStats().LargestFreeBlock < indexCount)
+            indexCapacity = std::max(mIndexCapacity * 2, mIndexCapacity + indexCount);
+
+        Rebuild(vertexCapacity, indexCapacity);
+        bool placed = Place(entry);
+        assert(placed);
+        (void)placed;
+    }
+
+    std::memcpy(&mVertexData[(size_t)entry.Range.BaseVertexLocation * mVertexByteStride], vertices,
+        (size_t)vertexCount * mVertexByteStride);
+    std::memcpy(&mIndexData[entry.Range.StartIndexLocation], indices, (size_t)indexCount * sizeof(uint32_t));
+    Upload(entry);
+
+    entry.Live = true;
+    return id;
+}
+
+void GeometryPool::Remove(uint32_t id)
+{
+    assert(id < mEntries.size() && mEntries[id].Live);
+
+    // Frames in flight may still draw the ranges.
+    Entry& entry = mEntries[id];
+    mPendingFrees.push_back({ 0, entry.VertexHandle, entry.IndexHandle });
+    entry = Entry();
+    mFreeIds.push_back(id);
+}
+
+const GeometryRange& GeometryPool::Get(uint32_t id) const
+{
+    assert(id < mEntries.size() && mEntries[id].Live);
+    return mEntries[id].Range;
+}
+
+D3D12_VERTEX_BUFFER_VIEW GeometryPool::VertexBufferView() const
+{
+    D3D12_VERTEX_BUFFER_VIEW vbv;
+    vbv.BufferLocation = mVertexBuffer->GetGPUVirtualAddress();
+    vbv.StrideInBytes = mVertexByteStride;
+    vbv.SizeInBytes = mVertexCapacity * mVertexByteStride;
+    return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW GeometryPool::IndexBufferView() const
+{
+    D3D12_INDEX_BUFFER_VIEW ibv;
+    ibv.BufferLocation = mIndexBuffer->GetGPUVirtualAddress();
+    ibv.Format = DXGI_FORMAT_R32_UINT;
+    ibv.SizeInBytes = mIndexCapacity * sizeof(uint32_t);
+    return ibv;
+}
+
+bool GeometryPool::Defragment(double maxFragmentation)
+{
+    double fragmentation = std::max(VertexStats().Fragmentation(), IndexStats().Fragmentation());
+    if (fragmentation <= maxFragmentation)
+        return false;
+
+    Rebuild(mVertexCapacity, mIndexCapacity);
+    return true;
+}
+
+UINT64 GeometryPool::Version() const
+{
+    return mVersion;
+}
+
+TlsfAllocator::Stats GeometryPool::VertexStats() const
+{
+    return mVertexRanges->GetStats();
+}
+
+TlsfAllocator::Stats GeometryPool::IndexStats() const
+{
+    return mIndexRanges->GetStats();
+}
+
+void GeometryPool::FinishFrame(UINT64 fenceValue)
+{
+    for (auto it = mPendingFrees.rbegin(); it != mPendingFrees.rend() && it->Fence == 0; ++it)
+        it->Fence = fenceValue;
+    for (auto it = mPendingBuffers.rbegin(); it != mPendingBuffers.rend() && it->Fence == 0; ++it)
+        it->Fence = fenceValue;
+}
+
+void GeometryPool::Retire(UINT64 completedFence)
+{
+    while (!mPendingFrees.empty() && mPendingFrees.front().Fence != 0 && mPendingFrees.front().Fence <= completedFence)
+    {
+        mVertexRanges->Free(mPendingFrees.front().VertexHandle);
+        mIndexRanges->Free(mPendingFrees.front().IndexHandle);
+        mPendingFrees.pop_front();
+    }
+
+    while (!mPendingBuffers.empty() && mPendingBuffers.front().Fence != 0 && mPendingBuffers.front().Fence <= completedFence)
+        mPendingBuffers.pop_front();
+}
+
+bool GeometryPool::Place(Entry& entry)
+{
+    TlsfAllocator::Allocation vertices = mVertexRanges->Allocate(entry.Range.VertexCount);
+    if (!vertices.IsValid())
+        return false;
+
+    TlsfAllocator::Allocation indices = mIndexRanges->Allocate(entry.Range.IndexCount);
+    if (!indices.IsValid())
+    {
+        mVertexRanges->Free(vertices.Handle);
+        return false;
+    }
+
+    entry.VertexHandle = vertices.Handle;
+    entry.IndexHandle = indices.Handle;
+    entry.Range.BaseVertexLocation = (INT)vertices.Offset;
+    entry.Range.StartIndexLocation = (UINT)indices.Offset;
+    return true;
+}
+
+void GeometryPool::Upload(const Entry& entry)
+{
+    const UINT64 vertexOffset = (UINT64)entry.Range.BaseVertexLocation * mVertexByteStride;
+    mUploader->UploadToBuffer(mVertexBuffer.Get(), vertexOffset, &mVertexData[vertexOffset],
+        (UINT64)entry.Range.VertexCount * mVertexByteStride);
+
+    mUploader->UploadToBuffer(mIndexBuffer.Get(), (UINT64)entry.Range.StartIndexLocation * sizeof(uint32_t),
+        &mIndexData[entry.Range.StartIndexLocation], (UINT64)entry.Range.IndexCount * sizeof(uint32_t));
+}
+
+void GeometryPool::Rebuild(UINT vertexCapacity, UINT indexCapacity)
+{
+    auto vertexRanges = std::make_unique<TlsfAllocator>(vertexCapacity, 1);
+    auto indexRanges = std::make_unique<TlsfAllocator>(indexCapacity, 1);
+    std::vector<BYTE> vertexData((size_t)vertexCapacity * mVertexByteStride);
+    std::vector<uint32_t> indexData(indexCapacity);
+
+    // A fresh allocator splits its single free block from the front, so the
+    // live geometry ends up packed at the start of both buffers.
+    for (Entry& entry : mEntries)
+    {
+        if (!entry.Live)
+            continue;
+
+        TlsfAllocator::Allocation vertices = vertexRanges->Allocate(entry.Range.VertexCount);
+        TlsfAllocator::Allocation indices = indexRanges->Allocate(entry.Range.IndexCount);
+        assert(vertices.IsValid() && indices.IsValid());
+
+        std::memcpy(&vertexData[vertices.Offset * mVertexByteStride],
+            &mVertexData[(size_t)entry.Range.BaseVertexLocation * mVertexByteStride],
+            (size_t)entry.Range.VertexCount * mVertexByteStride);
+        std::memcpy(&indexData[indices.Offset], &mIndexData[entry.Range.StartIndexLocation],
+            (size_t)entry.Range.IndexCount * sizeof(uint32_t));
+
+        entry.VertexHandle = vertices.Handle;
+        entry.IndexHandle = indices.Handle;
+        entry.Range.BaseVertexLocation = (INT)vertices.Offset;
+        entry.Range.StartIndexLocation = (UINT)indices.Offset;
+    }
+
+    // Ranges waiting for their fence belong to the old buffers, which are
+    // kept alive until then anyway.
+    mPendingFrees.clear();
+    if (mVertexBuffer != nullptr)
+        mPendingBuffers.push_back({ 0, std::move(mVertexBuffer) });
+    if (mIndexBuffer != nullptr)
+        mPendingBuffers.push_back({ 0, std::move(mIndexBuffer) });
+
+    mVertexRanges = std::move(vertexRanges);
+    mIndexRanges = std::move(indexRanges);
+    mVertexData = std::move(vertexData);
+    mIndexData = std::move(indexData);
+    mVertexCapacity = vertexCapacity;
+    mIndexCapacity = indexCapacity;
+
+    mVertexBuffer = mAllocator->CreateBuffer((UINT64)vertexCapacity * mVertexByteStride,
+        D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+    mIndexBuffer = mAllocator->CreateBuffer((UINT64)indexCapacity * sizeof(uint32_t),
+        D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+
+    // The packed prefix goes up in one copy per buffer.
+    const UINT64 usedVertices = mVertexRanges->GetStats().UsedSize;
+    const UINT64 usedIndices = mIndexRanges->GetStats().UsedSize;
+    if (usedVertices > 0)
+        mUploader->UploadToBuffer(mVertexBuffer.Get(), 0, mVertexData.data(), usedVertices * mVertexByteStride);
+    if (usedIndices > 0)
+        mUploader->UploadToBuffer(mIndexBuffer.Get(), 0, mIndexData.data(), usedIndices * sizeof(uint32_t));
+
+    mVersion++;
+}
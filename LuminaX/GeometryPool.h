@@ -0,0 +1,123 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "GpuHeapAllocator.h"
+#include "TlsfAllocator.h"
+
+class UploadManager;
+
+// Where a piece of geometry currently lives in the pool; the values plug
+// straight into DrawIndexedInstanced.
+struct GeometryRange
+{
+    UINT IndexCount = 0;
+    UINT StartIndexLocation = 0;
+    INT BaseVertexLocation = 0;
+    UINT VertexCount = 0;
+};
+
+// One vertex buffer and one index buffer shared by all geometry, so every
+// render item draws with the same IA bindings. Ranges in both buffers are
+// handed out by TlsfAllocators (granularity of one vertex / one index) and
+// filled through the UploadManager; indices are 32 bit and relative to the
+// geometry's BaseVertexLocation.
+//
+// A CPU copy of the contents is kept so that the pool can be rebuilt into
+// new buffers: when it runs out of space, and on Defragment. Rebuilding
+// packs the ranges tightly and moves them, which bumps Version(); callers
+// holding resolved GeometryRanges refresh them when it changes. Replaced
+// buffers and removed ranges are only recycled once the frame fence passed
+// to FinishFrame has completed, the same as LinearUploadAllocator.
+class GeometryPool
+{
+public:
+    static constexpr uint32_t InvalidId = ~0u;
+
+    GeometryPool(GpuHeapAllocator* allocator, UploadManager* uploader,
+        UINT vertexByteStride, UINT vertexCapacity, UINT indexCapacity);
+
+    GeometryPool(const GeometryPool& rhs) = delete;
+    GeometryPool& operator=(const GeometryPool& rhs) = delete;
+
+    // Copies the geometry into the pool and queues its upload. Returns the id
+    // used with Get and Remove.
+    uint32_t Add(const void* vertices, UINT vertexCount, const uint32_t* indices, UINT indexCount);
+    void Remove(uint32_t id);
+
+    const GeometryRange& Get(uint32_t id) const;
+
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView() const;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView() const;
+
+    // Packs all live geometry to the front of new buffers when the free space
+    // of either buffer is split up more than maxFragmentation (0..1).
+    // Returns true if the pool was rebuilt.
+    bool Defragment(double maxFragmentation);
+
+    // Incremented whenever geometry has moved.
+    UINT64 Version() const;
+
+    TlsfAllocator::Stats VertexStats() const;
+    TlsfAllocator::Stats IndexStats() const;
+
+    // Stamps ranges and buffers released since the last call with the fence
+    // of the frame that may still use them.
+    void FinishFrame(UINT64 fenceValue);
+    // Recycles everything whose fence has completed.
+    void Retire(UINT64 completedFence);
+
+private:
+    struct Entry
+    {
+        GeometryRange Range;
+        uint32_t VertexHandle = TlsfAllocator::InvalidHandle;
+        uint32_t IndexHandle = TlsfAllocator::InvalidHandle;
+        bool Live = false;
+    };
+
+    struct PendingFree
+    {
+        UINT64 Fence;
+        uint32_t VertexHandle;
+        uint32_t IndexHandle;
+    };
+
+    struct PendingBuffer
+    {
+        UINT64 Fence;
+        GpuResource Resource;
+    };
+
+    bool Place(Entry& entry);
+    void Upload(const Entry& entry);
+    void Rebuild(UINT vertexCapacity, UINT indexCapacity);
+
+private:
+    GpuHeapAllocator* mAllocator = nullptr;
+    UploadManager* mUploader = nullptr;
+    UINT mVertexByteStride = 0;
+
+    UINT mVertexCapacity = 0;
+    UINT mIndexCapacity = 0;
+    std::unique_ptr<TlsfAllocator> mVertexRanges;
+    std::unique_ptr<TlsfAllocator> mIndexRanges;
+
+    GpuResource mVertexBuffer;
+    GpuResource mIndexBuffer;
+
+    // CPU copy of the buffer contents, laid out the same as on the GPU.
+    std::vector<BYTE> mVertexData;
+    std::vector<uint32_t> mIndexData;
+
+    std::vector<Entry> mEntries;
+    std::vector<uint32_t> mFreeIds;
+
+    std::deque<PendingFree> mPendingFrees;
+    std::deque<PendingBuffer> mPendingBuffers;
+
+    UINT64 mVersion = 0;
+};
@@ -0,0 +1,197 @@
+#include "GpuHeapAllocator.h"
+#include "directx/d3dx12.h"
+#include "GraphicsUtil.h"
+#include <algorithm>
+#include <cassert>
+
+using Microsoft::WRL::ComPtr;
+
+GpuResource::~GpuResource()
+{
+    Reset();
+}
+
+GpuResource::GpuResource(GpuResource&& rhs) noexcept
+    : mResource(std::move(rhs.mResource)), mAllocator(rhs.mAllocator),
+      mBlock(rhs.mBlock), mHandle(rhs.mHandle)
+{
+    rhs.mAllocator = nullptr;
+    rhs.mHandle = TlsfAllocator::InvalidHandle;
+}
+
+GpuResource& GpuResource::operator=(GpuResource&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        Reset();
+        mResource = std::move(rhs.mResource);
+        mAllocator = rhs.mAllocator;
+        mBlock = rhs.mBlock;
+        mHandle = rhs.mHandle;
+        rhs.mAllocator = nullptr;
+        rhs.mHandle = TlsfAllocator::InvalidHandle;
+    }
+    return *this;
+}
+
+void GpuResource::Reset()
+{
+    // Release the resource before its memory can be handed out again.
+    mResource.Reset();
+    if (mAllocator != nullptr)
+        mAllocator->Free(mBlock, mHandle);
+
+    mAllocator = nullptr;
+    mHandle = TlsfAllocator::InvalidHandle;
+}
+
+GpuHeapAllocator::GpuHeapAllocator(ID3D12Device* device, UINT64 blockSize)
+    : md3dDevice(device), mBlockSize(blockSize)
+{
+}
+
+GpuHeapAllocator::~GpuHeapAllocator()
+{
+    // Every GpuResource must be gone by now, otherwise its heap dies under it.
+    for (const auto& block : mBlocks)
+        assert(block.Allocator == nullptr || block.Allocator->Empty());
+}
+
+GpuResource GpuHeapAllocator::CreateResource(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType,
+    D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE* clearValue)
+{
+    const D3D12_RESOURCE_ALLOCATION_INFO info = md3dDevice->GetResourceAllocationInfo(0, 1, &desc);
+    const HeapKind kind = KindOf(desc);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t blockIndex = 0;
+    TlsfAllocator::Allocation allocation;
+    for (; blockIndex < (uint32_t)mBlocks.size(); ++blockIndex)
+    {
+        Block& block = mBlocks[blockIndex];
+        if (block.Heap == nullptr || block.Type != heapType || block.Kind != kind)
+            continue;
+
+        allocation = block.Allocator->Allocate(info.SizeInBytes, info.Alignment);
+        if (allocation.IsValid())
+            break;
+    }
+
+    if (!allocation.IsValid())
+    {
+        // Resources larger than a block get a dedicated one.
+        blockIndex = CreateBlock(heapType, kind, std::max(mBlockSize, info.SizeInBytes));
+        allocation = mBlocks[blockIndex].Allocator->Allocate(info.SizeInBytes, info.Alignment);
+        assert(allocation.IsValid());
+    }
+
+    // The range goes back before the failure is thrown, or it would leak.
+    GpuResource resource;
+    const HRESULT result = md3dDevice->CreatePlacedResource(mBlocks[blockIndex].Heap.Get(), allocation.Offset,
+        &desc, initialState, clearValue, IID_PPV_ARGS(resource.mResource.GetAddressOf()));
+    if (FAILED(result))
+        mBlocks[blockIndex].Allocator->Free(allocation.Handle);
+    ThrowIfFailed(result);
+
+    resource.mAllocator = this;
+    resource.mBlock = blockIndex;
+    resource.mHandle = allocation.Handle;
+    return resource;
+}
+
+GpuResource GpuHeapAllocator::CreateBuffer(UINT64 byteSize, D3D12_HEAP_TYPE heapType,
+    D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags)
+{
+    auto desc = CD3DX12_RESOURCE_DESC::Buffer(byteSize, flags);
+    return CreateResource(desc, heapType, initialState);
+}
+
+void GpuHeapAllocator::Trim()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto& block : mBlocks)
+    {
+        if (block.Heap != nullptr && block.Allocator->Empty())
+        {
+            block.Heap.Reset();
+            block.Allocator.reset();
+        }
+    }
+}
+
+GpuHeapAllocator::Stats GpuHeapAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Stats stats;
+    for (const auto& block : mBlocks)
+    {
+        if (block.Heap == nullptr)
+            continue;
+
+        const TlsfAllocator::Stats blockStats = block.Allocator->GetStats();
+        stats.BlockCount++;
+        stats.ReservedBytes += blockStats.TotalSize;
+        stats.UsedBytes += blockStats.UsedSize;
+        stats.LargestFreeBlock = std::max(stats.LargestFreeBlock, blockStats.LargestFreeBlock);
+        stats.AllocationCount += blockStats.AllocationCount;
+        stats.FreeRangeCount += blockStats.FreeBlockCount;
+        stats.WorstFragmentation = std::max(stats.WorstFragmentation, blockStats.Fragmentation());
+    }
+    return stats;
+}
+
+GpuHeapAllocator::HeapKind GpuHeapAllocator::KindOf(const D3D12_RESOURCE_DESC& desc)
+{
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        return HeapKind::Buffers;
+    if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+        return HeapKind::RenderTargets;
+    return HeapKind::Textures;
+}
+
+uint32_t GpuHeapAllocator::CreateBlock(D3D12_HEAP_TYPE type, HeapKind kind, UINT64 size)
+{
+    size = (size + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~(UINT64)(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1);
+
+    D3D12_HEAP_FLAGS flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+    UINT64 alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    if (kind == HeapKind::Textures)
+    {
+        flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+    }
+    else if (kind == HeapKind::RenderTargets)
+    {
+        // Multisampled targets need 4MB placement.
+        flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+        alignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+    }
+
+    CD3DX12_HEAP_DESC heapDesc(size, CD3DX12_HEAP_PROPERTIES(type), alignment, flags);
+
+    Block block;
+    ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(block.Heap.GetAddressOf())));
+    block.Type = type;
+    block.Kind = kind;
+    block.Allocator = std::make_unique<TlsfAllocator>(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); ++i)
+    {
+        if (mBlocks[i].Heap == nullptr)
+        {
+            mBlocks[i] = std::move(block);
+            return i;
+        }
+    }
+
+    mBlocks.push_back(std::move(block));
+    return (uint32_t)mBlocks.size() - 1;
+}
+
+void GpuHeapAllocator::Free(uint32_t block, uint32_t handle)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBlocks[block].Allocator->Free(handle);
+}
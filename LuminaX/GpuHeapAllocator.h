@@ -0,0 +1,106 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TlsfAllocator.h"
+
+class GpuHeapAllocator;
+
+// A placed resource plus the heap range behind it. Move-only; the range goes
+// back to the allocator when the resource is reset or destroyed, so (as with
+// a ComPtr) the GPU must be done with it by then.
+class GpuResource
+{
+public:
+    GpuResource() = default;
+    ~GpuResource();
+
+    GpuResource(GpuResource&& rhs) noexcept;
+    GpuResource& operator=(GpuResource&& rhs) noexcept;
+    GpuResource(const GpuResource& rhs) = delete;
+    GpuResource& operator=(const GpuResource& rhs) = delete;
+
+    ID3D12Resource* Get() const { return mResource.Get(); }
+    ID3D12Resource* operator->() const { return mResource.Get(); }
+    bool operator==(std::nullptr_t) const { return mResource == nullptr; }
+    bool operator!=(std::nullptr_t) const { return mResource != nullptr; }
+
+    void Reset();
+
+private:
+    friend class GpuHeapAllocator;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mResource;
+    GpuHeapAllocator* mAllocator = nullptr;
+    uint32_t mBlock = 0;
+    uint32_t mHandle = TlsfAllocator::InvalidHandle;
+};
+
+// Creates placed resources in large ID3D12Heap blocks instead of one committed
+// resource (and one implicit heap) each. Every block is managed by a
+// TlsfAllocator. Buffers, plain textures and render target/depth textures get
+// separate blocks so that resource heap tier 1 hardware is supported.
+class GpuHeapAllocator
+{
+public:
+    struct Stats
+    {
+        uint32_t BlockCount = 0;
+        uint64_t ReservedBytes = 0;     // size of all heaps
+        uint64_t UsedBytes = 0;
+        uint64_t LargestFreeBlock = 0;
+        uint32_t AllocationCount = 0;
+        uint32_t FreeRangeCount = 0;
+        double WorstFragmentation = 0.0;
+    };
+
+    GpuHeapAllocator(ID3D12Device* device, UINT64 blockSize);
+    ~GpuHeapAllocator();
+
+    GpuHeapAllocator(const GpuHeapAllocator& rhs) = delete;
+    GpuHeapAllocator& operator=(const GpuHeapAllocator& rhs) = delete;
+
+    GpuResource CreateResource(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE heapType,
+        D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE* clearValue = nullptr);
+    GpuResource CreateBuffer(UINT64 byteSize, D3D12_HEAP_TYPE heapType,
+        D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+
+    // Releases blocks that no longer hold any resource.
+    void Trim();
+
+    Stats GetStats() const;
+
+private:
+    enum class HeapKind
+    {
+        Buffers,
+        Textures,
+        RenderTargets
+    };
+
+    struct Block
+    {
+        Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+        D3D12_HEAP_TYPE Type = D3D12_HEAP_TYPE_DEFAULT;
+        HeapKind Kind = HeapKind::Buffers;
+        std::unique_ptr<TlsfAllocator> Allocator;
+    };
+
+    static HeapKind KindOf(const D3D12_RESOURCE_DESC& desc);
+    uint32_t CreateBlock(D3D12_HEAP_TYPE type, HeapKind kind, UINT64 size);
+
+    friend class GpuResource;
+    void Free(uint32_t block, uint32_t handle);
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    UINT64 mBlockSize = 0;
+
+    // Slots of released blocks are reused, so indices held by GpuResource stay valid.
+    std::vector<Block> mBlocks;
+    mutable std::mutex mMutex;
+};
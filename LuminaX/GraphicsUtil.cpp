@@ -9,6 +9,9 @@
 #include "DDSTextureLoader.h"
 #include "WICTextureLoader.h"
 #include "directx/d3dx12.h"
+#include "ShaderCache.h"
+#include "TextureCache.h"
+#include "UploadManager.h"
 
 
 UINT GraphicsUtil::CalcConstantBufferByteSize(UINT byteSize)
@@ -25,27 +28,139 @@ UINT GraphicsUtil::CalcConstantBufferByteSize(UINT byteSize)
 	return (byteSize + 255) & ~255;
 }
 
+namespace
+{
+	// Resolves the includes of a shader relative to the including shader's
+	// directory, like the standard handler does, from the asset pack or else
+	// from the loose files.
+	class ShaderInclude : public ID3DInclude
+	{
+	public:
+		explicit ShaderInclude(std::filesystem::path directory) : mDirectory(std::move(directory)) {}
+
+		HRESULT __stdcall Open(D3D_INCLUDE_TYPE, LPCSTR fileName, LPCVOID, LPCVOID* data, UINT* bytes) override
+		{
+			const std::wstring path = (mDirectory / fileName).lexically_normal().wstring();
+
+			// Includes have to stay readable until the compile is done.
+			std::span<const uint8_t> contents;
+			if (const AssetPackEntry* entry = GraphicsUtil::gAssetPack.Find(path))
+			{
+				mStorage.emplace_back();
+				contents = GraphicsUtil::gAssetPack.Read(*entry, mStorage.back());
+			}
+			else
+			{
+				MappedFile file;
+				if (!file.Open(path))
+					return E_FAIL;
+				contents = { file.Data(), (size_t)file.Size() };
+				mFiles.push_back(std::move(file));
+			}
+			if (contents.empty())
+				return E_FAIL;
+
+			*data = contents.data();
+			*bytes = (UINT)contents.size();
+			return S_OK;
+		}
+
+		HRESULT __stdcall Close(LPCVOID) override
+		{
+			return S_OK;
+		}
+
+	private:
+		std::filesystem::path mDirectory;
+		std::vector<std::unique_ptr<uint8_t[]>> mStorage;
+		std::vector<MappedFile> mFiles;
+	};
+
+	std::string DefinesKey(const D3D_SHADER_MACRO* defines)
+	{
+		std::string key;
+		for (; defines != nullptr && defines->Name != nullptr; ++defines)
+		{
+			key += defines->Name;
+			key += '=';
+			key += defines->Definition != nullptr ? defines->Definition : "";
+			key += '\n';
+		}
+		return key;
+	}
+}
+
 Microsoft::WRL::ComPtr<ID3DBlob> GraphicsUtil::CompileShader(const std::wstring& fileName,
                                                              const D3D_SHADER_MACRO* defines, const std::string& entryPoint, const std::string& target)
 {
 	Microsoft::WRL::ComPtr<ID3DBlob> byteCode;
 	Microsoft::WRL::ComPtr<ID3DBlob> errorCode;
-	if (!std::filesystem::exists(fileName))
-	{
-		std::wstring msg = L"File Not found - " + fileName;
-		MessageBox(NULL, fileName.c_str(), L"Error", MB_OK);
-	}
 	UINT flags = 0;
 #if defined(DEBUG) || defined(_DEBUG)
 	flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
-	D3DCompileFromFile(fileName.c_str(), defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint.c_str(), target.c_str(), flags, 0, &byteCode, &errorCode);
+
+	// Shaders in the asset pack are read from its mapping; loose files are
+	// only looked for when the pack doesn't have them.
+	std::unique_ptr<uint8_t[]> storage;
+	std::span<const uint8_t> source;
+	MappedFile file;
+	if (const AssetPackEntry* entry = gAssetPack.Find(fileName))
+		source = gAssetPack.Read(*entry, storage);
+	else if (file.Open(fileName))
+		source = { file.Data(), (size_t)file.Size() };
+	else
+	{
+		std::wstring msg = L"File Not found - " + fileName;
+		MessageBox(NULL, fileName.c_str(), L"Error", MB_OK);
+		return nullptr;
+	}
+
+	ShaderInclude include(std::filesystem::path(fileName).parent_path());
+	const std::string sourceName = std::filesystem::path(fileName).string();
+
+	// The cache is keyed by the preprocessed source, so it is only valid as
+	// long as no included file changes either. Preprocessing is cheap next
+	// to compiling.
+	Microsoft::WRL::ComPtr<ID3DBlob> preprocessed;
+	std::wstring cacheFile;
+	ShaderCacheKey key;
+	const std::string definesKey = DefinesKey(defines);
+	if (!gShaderCacheDirectory.empty() &&
+		SUCCEEDED(D3DPreprocess(source.data(), source.size(), sourceName.c_str(), defines, &include,
+			&preprocessed, nullptr)))
+	{
+		key.Source = { static_cast<const char*>(preprocessed->GetBufferPointer()), preprocessed->GetBufferSize() };
+		key.Defines = definesKey;
+		key.EntryPoint = entryPoint;
+		key.Target = target;
+		key.Flags = flags;
+		key.CompilerVersion = D3D_COMPILER_VERSION;
+		cacheFile = ShaderCache::EntryPath(gShaderCacheDirectory, key);
+
+		std::vector<uint8_t> cached;
+		if (ShaderCache::Load(cacheFile, key, cached) && SUCCEEDED(D3DCreateBlob(cached.size(), &byteCode)))
+		{
+			memcpy(byteCode->GetBufferPointer(), cached.data(), cached.size());
+			return byteCode;
+		}
+	}
+
+	// Compiled from the original source, so debug info refers to the files.
+	D3DCompile(source.data(), source.size(), sourceName.c_str(), defines, &include,
+		entryPoint.c_str(), target.c_str(), flags, 0, &byteCode, &errorCode);
 
 	if (errorCode != nullptr)
 	{
 		//MessageBoxA(NULL, (char*)errorCode->GetBufferPointer(), "Error", MB_OK);
 		OutputDebugStringA((char*)errorCode->GetBufferPointer());
 	}
+
+	if (byteCode != nullptr && !cacheFile.empty())
+	{
+		ShaderCache::Store(cacheFile, key,
+			{ static_cast<const uint8_t*>(byteCode->GetBufferPointer()), byteCode->GetBufferSize() });
+	}
 	return byteCode;
 }
 
@@ -69,75 +184,137 @@ DirectX::XMVECTOR GraphicsUtil::SphericalToCartesian(float radius, float theta,
 		1.0f);
 }
 
-bool GraphicsUtil::LoadTextureFromFile(const std::wstring& fileName, ID3D12Device* device,
-	ID3D12GraphicsCommandList* cmdList, Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
-	Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap)
+size_t DecodedTexture::ByteSize() const
 {
-	if (!std::filesystem::exists(fileName))
-		return false;
+	size_t bytes = 0;
+	for (auto& subresource : Subresources)
+		bytes += (size_t)subresource.SlicePitch;
+	return bytes;
+}
 
-	
-	if (std::filesystem::path(fileName).extension()==".dds")
+namespace
+{
+	// Maps the DDS file and parses it where it lies: the subresources point
+	// into the mapping, so the levels are read from the file only once, when
+	// the uploader copies their rows into staging memory.
+	HRESULT LoadDDSInPlace(const std::wstring& fileName, ID3D12Device* device, DecodedTexture& texture)
 	{
-		std::unique_ptr<uint8_t[]> ddsData;
-		std::vector<D3D12_SUBRESOURCE_DATA> subresources;
-		ThrowIfFailed(DirectX::LoadDDSTextureFromFile(device, fileName.c_str(), texture.ReleaseAndGetAddressOf(),
-			ddsData, subresources));
+		if (!texture.File.Open(fileName))
+			return HRESULT_FROM_WIN32(GetLastError());
 
-		const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0,
-			static_cast<UINT>(subresources.size()));
-
-		auto debug = texture->GetDesc();
-		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
-		auto desc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
+		texture.Data.reset();
+		return DirectX::LoadDDSTextureFromMemory(device, texture.File.Data(), (size_t)texture.File.Size(),
+			texture.Resource.ReleaseAndGetAddressOf(), texture.Subresources);
+	}
+}
 
-		ThrowIfFailed(device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&desc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(textureUploadHeap.GetAddressOf())));
+bool GraphicsUtil::DecodeTextureFromFile(const std::wstring& fileName, ID3D12Device* device,
+	DecodedTexture& texture, const TextureImportOptions& options)
+{
+	// Files in the asset pack are decoded from its mapping. DDS files are
+	// stored uncompressed there, so their levels are used in place.
+	std::unique_ptr<uint8_t[]> packedStorage;
+	std::span<const uint8_t> packed;
+	if (const AssetPackEntry* entry = gAssetPack.Find(fileName))
+	{
+		packed = gAssetPack.Read(*entry, packedStorage);
+		if (packed.empty())
+			return false;
+	}
+	else if (!std::filesystem::exists(fileName))
+		return false;
 
-		UpdateSubresources(cmdList, texture.Get(), textureUploadHeap.Get(),
-			0, 0, static_cast<UINT>(subresources.size()), subresources.data());
+	// The loaders only create the resource and decode the data; uploading it
+	// is up to the caller.
+	if (std::filesystem::path(fileName).extension()==".dds")
+	{
+		if (packed.empty())
+			ThrowIfFailed(LoadDDSInPlace(fileName, device, texture));
+		else
+		{
+			texture.Data = std::move(packedStorage);
+			ThrowIfFailed(DirectX::LoadDDSTextureFromMemory(device, packed.data(), packed.size(),
+				texture.Resource.ReleaseAndGetAddressOf(), texture.Subresources));
+		}
+		return true;
+	}
 
-		auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
-			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	// Compressed imports are looked up in the cache first, so only the first
+	// load of an image pays for the encoding. An unreadable entry is simply
+	// encoded and written again.
+	const bool compress = options.Compression != BlockCompressor::Format::None;
+	std::wstring cacheFile;
+	if (compress && !gTextureCacheDirectory.empty())
+	{
+		const uint64_t settings = (uint64_t)options.Compression | ((uint64_t)options.Quality << 8) |
+			((uint64_t)options.MipFilter << 16) | ((uint64_t)BlockCompressor::Version << 32);
+		cacheFile = packed.empty() ? TextureCache::EntryPath(gTextureCacheDirectory, fileName, settings) :
+			TextureCache::EntryPath(gTextureCacheDirectory, fileName, packed, settings);
 
-		cmdList->ResourceBarrier(1, &barrier);
-		return true;
+		if (!cacheFile.empty() && std::filesystem::exists(cacheFile) &&
+			SUCCEEDED(LoadDDSInPlace(cacheFile, device, texture)))
+			return true;
 	}
 
-	std::unique_ptr<uint8_t[]> decodedData;
-	D3D12_SUBRESOURCE_DATA subresource;
-	ThrowIfFailed(
-		DirectX::LoadWICTextureFromFile(device, fileName.c_str(), texture.ReleaseAndGetAddressOf(),
-			decodedData, subresource));
+	// WIC images have a single level. The resource is created with room for
+	// the full chain and the remaining levels are generated here; formats the
+	// generator can't filter are decoded again as RGBA8.
+	std::unique_ptr<uint8_t[]> top;
+	D3D12_SUBRESOURCE_DATA topLevel = {};
+	auto loadWic = [&](DirectX::WIC_LOADER_FLAGS loadFlags)
+	{
+		if (!packed.empty())
+			return DirectX::LoadWICTextureFromMemoryEx(device, packed.data(), packed.size(), 0, D3D12_RESOURCE_FLAG_NONE,
+				loadFlags, texture.Resource.ReleaseAndGetAddressOf(), top, topLevel);
+		return DirectX::LoadWICTextureFromFileEx(device, fileName.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
+			loadFlags, texture.Resource.ReleaseAndGetAddressOf(), top, topLevel);
+	};
+	ThrowIfFailed(loadWic(DirectX::WIC_LOADER_MIP_RESERVE));
+
+	D3D12_RESOURCE_DESC desc = texture.Resource->GetDesc();
+	if (!MipGenerator::IsSupported(desc.Format))
+	{
+		ThrowIfFailed(loadWic(DirectX::WIC_LOADER_MIP_RESERVE | DirectX::WIC_LOADER_FORCE_RGBA32));
+		desc = texture.Resource->GetDesc();
+	}
 
-	const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, 1);
+	MipGenerator::Generate(desc.Format, (UINT)desc.Width, desc.Height, desc.MipLevels,
+		topLevel.pData, (size_t)topLevel.RowPitch, options.MipFilter, texture.Data, texture.Subresources);
 
-	CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
+	if (compress && BlockCompressor::CanCompress(desc.Format, (UINT)desc.Width, desc.Height))
+	{
+		std::unique_ptr<uint8_t[]> blocks;
+		std::vector<D3D12_SUBRESOURCE_DATA> levels;
+		BlockCompressor::Compress(options.Compression, options.Quality, desc.Format, (UINT)desc.Width, desc.Height,
+			texture.Subresources, blocks, levels);
 
-	auto desc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
+		// The WIC loader created the resource in the uncompressed format.
+		desc.Format = BlockCompressor::CompressedFormat(options.Compression, desc.Format);
+		desc.Alignment = 0;
+		CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+		ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &desc,
+			D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(texture.Resource.ReleaseAndGetAddressOf())));
 
-	ThrowIfFailed(
-		device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&desc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(textureUploadHeap.GetAddressOf())));
+		texture.Data = std::move(blocks);
+		texture.Subresources = std::move(levels);
 
-	UpdateSubresources(cmdList, texture.Get(), textureUploadHeap.Get(),
-		0, 0, 1, &subresource);
+		if (!cacheFile.empty())
+			TextureCache::Write(cacheFile, desc.Format, (UINT)desc.Width, desc.Height, texture.Subresources);
+	}
+	return true;
+}
 
-	auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
-		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	cmdList->ResourceBarrier(1, &barrier);
+bool GraphicsUtil::LoadTextureFromFile(const std::wstring& fileName, ID3D12Device* device,
+	UploadManager& uploader, Microsoft::WRL::ComPtr<ID3D12Resource>& texture, const TextureImportOptions& options)
+{
+	DecodedTexture decoded;
+	if (!DecodeTextureFromFile(fileName, device, decoded, options))
+		return false;
 
-	return true;;
+	// The upload manager copies the data into its staging memory right away.
+	uploader.UploadToTexture(decoded.Resource.Get(), 0, decoded.Subresources);
+	texture = decoded.Resource;
+	return true;
 }
 
 DxException::DxException(HRESULT hr, const std::wstring& functionName, const std::wstring& filename, int lineNumber)
@@ -1,10 +1,46 @@
 #pragma once 
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <wrl/client.h>
 #include "directx/d3d12.h"
 #include "directx/d3dx12.h"
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+#include "AssetPack.h"
+#include "BlockCompressor.h"
+#include "GeometryPool.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+#include "TextureStreamer.h"
+
+class UploadManager;
+
+// How WIC images are turned into textures. DDS files are used as saved.
+struct TextureImportOptions
+{
+    MipGenerator::Filter MipFilter = MipGenerator::Filter::Kaiser;
+
+    // Images that can't be block compressed (odd sizes, float formats) stay
+    // uncompressed.
+    BlockCompressor::Format Compression = BlockCompressor::Format::BC7;
+    BlockCompressor::Quality Quality = BlockCompressor::Quality::Normal;
+};
+
+// A texture resource with its decoded, not yet uploaded contents.
+// Subresources point into Data, or into File for DDS files, whose levels are
+// used in place from the mapped file.
+struct DecodedTexture
+{
+    Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+    std::unique_ptr<uint8_t[]> Data;
+    MappedFile File;
+    std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+
+    size_t ByteSize() const;
+};
 
 class GraphicsUtil
 {
@@ -16,13 +52,31 @@ public:
 	                                               const std::string& entryPoint, const std::string& target);
     static DirectX::XMFLOAT4X4 Identity4x4();
     static DirectX::XMVECTOR SphericalToCartesian(float radius, float theta, float phi);
-    static const int gNumFrameResources;
 
+    // Where compressed imports are cached; empty disables the cache.
+    static std::wstring gTextureCacheDirectory;
+    // Where compiled shaders are cached; empty disables the cache.
+    static std::wstring gShaderCacheDirectory;
+    // Shaders and textures are read from here first when it is open.
+    static AssetPack gAssetPack;
+
+
+    // Reads and decodes a DDS or WIC image file and creates the texture for it.
+    // WIC images get a full mip chain and are block compressed as options
+    // say, with the result cached on disk; DDS files keep the levels and
+    // format they were saved with. Safe to call from worker threads.
+    static bool DecodeTextureFromFile(const std::wstring& fileName,
+        ID3D12Device* device,
+        DecodedTexture& texture,
+        const TextureImportOptions& options = {});
 
+    // Creates the texture and queues its upload; the data is on the GPU once
+    // the uploader's next batch completes.
     static bool LoadTextureFromFile(const std::wstring& fileName,
         ID3D12Device* device,
-        ID3D12GraphicsCommandList* cmdList,
-        Microsoft::WRL::ComPtr<ID3D12Resource>& texture, Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap);
+        UploadManager& uploader,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+        const TextureImportOptions& options = {});
 };
 
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
@@ -35,62 +89,25 @@ struct SubmeshGeometry
     UINT StartIndexLocation = 0;
     INT BaseVertexLocation = 0;
 
-    // Bounding box of the geometry defined by this submesh. 
-    // This is used in later chapters of the book.
-    // DirectX::BoundingBox Bounds;
+    // Local-space bounding sphere of the geometry defined by this submesh.
+    // Used to estimate the projected size of a render item for LOD selection.
+    DirectX::BoundingSphere Bounds;
+
+    // Object-space length covered by one unit of texture coordinates, the
+    // square root of surface area over UV area. Used for mip streaming.
+    float UVDensity = 1.0f;
+
+    // Id in the GeometryPool. The draw parameters above are a copy of the
+    // pool range and are refreshed when the pool moves geometry.
+    uint32_t PoolId = GeometryPool::InvalidId;
 };
+// A named set of submeshes. The vertex and index data live in the shared
+// GeometryPool, so all geometry is drawn with the same IA bindings.
 struct MeshGeometry
 {
     std::string Name;
 
-    // ý ޸ 纻Դϴ. ؽ ε  ϱ   մϴ.
-    // ڰ ùٸ ɽ ؾմϴ.
-    Microsoft::WRL::ComPtr<ID3DBlob> VertexBufferCPU = nullptr;
-    Microsoft::WRL::ComPtr<ID3DBlob> IndexBufferCPU = nullptr;
-
-    Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
-    Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
-
-    Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
-    Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
-
-    // Data about the buffers.
-    UINT VertexByteStride = 0;
-    UINT VertexBufferByteSize = 0;
-    DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
-    UINT IndexBufferByteSize = 0;
-
-    // A MeshGeometry may store multiple geometries in one vertex/index buffer.
-    // Use this container to define the Submesh geometries so we can draw
-    // the Submeshes individually.
     std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
-
-    D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
-    {
-        D3D12_VERTEX_BUFFER_VIEW vbv;
-        vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
-        vbv.StrideInBytes = VertexByteStride;
-        vbv.SizeInBytes = VertexBufferByteSize;
-
-        return vbv;
-    }
-
-    D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
-    {
-        D3D12_INDEX_BUFFER_VIEW ibv;
-        ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
-        ibv.Format = IndexFormat;
-        ibv.SizeInBytes = IndexBufferByteSize;
-
-        return ibv;
-    }
-
-    // We can free this memory after we finish upload to the GPU.
-    void DisposeUploaders()
-    {
-        VertexBufferUploader = nullptr;
-        IndexBufferUploader = nullptr;
-    }
 };
 
 struct Light
@@ -105,6 +122,8 @@ struct Light
 
 #define MaxLights 16
 
+struct Texture;
+
 //  ϱ   ͸ üԴϴ.
 //  3D   ͸ ӹν ˴ϴ.
 struct Material
@@ -121,12 +140,13 @@ struct Material
     // 븻 ؽĿ شϴ SRV  εԴϴ.
     int NormalSrvHeapIndex = -1;
 
-    // ͸ Ǿٴ  Ÿ Ƽ ÷Դϴ.
-    // ׸    ۸ Ʈ ؾմϴ.
-    // ͸  ۴  Ӹ ϱ    ҽ
-    // Ʈ ؾմϴ. ׷Ƿ ͸   NumFramesDirty = gNumFrameResources
-    // ؼ   ҽ Ʈ ǵ ؾմϴ.
-    int NumFramesDirty = GraphicsUtil::gNumFrameResources;
+    // Texture behind DiffuseSrvHeapIndex, if any. While it is still loading
+    // the index points at the fallback texture.
+    Texture* DiffuseTex = nullptr;
+
+    // Material buffers are uploaded from the frame resources' dirty sets, so
+    // changes to the constants below must be reported to the owner
+    // (DemoApp::MarkMaterialDirty).
 
     // ̵ Ǵ ͸   Դϴ.
     DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -145,7 +165,14 @@ struct Texture
     int heapIndex = -1;
 
     Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
-    Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+    // Set once the contents are on the GPU; the SRV at heapIndex is only
+    // valid from then on.
+    bool Resident = false;
+
+    // Id in the TextureStreamer for streamed textures. Those own two SRV
+    // slots from heapIndex on and use the one TextureStreamer::SrvSlot picks.
+    uint32_t StreamId = TextureStreamer::InvalidId;
 };
 
 inline std::wstring AnsiToWString(const std::string& str)
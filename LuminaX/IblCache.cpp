@@ -0,0 +1,156 @@
+#include "IblCache.h"
+#include "FileUtil.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    struct IblCacheHeader
+    {
+        static constexpr uint32_t MagicValue = 0x4249584C; // "LXIB"
+
+        uint32_t Magic = MagicValue;
+        uint32_t Version = IblCache::Version;
+        uint64_t Key = 0;
+        float IrradianceSH[SphericalHarmonics::CoefficientCount][4] = {};
+        uint32_t SpecularFormat = 0;
+        uint32_t SpecularTexelSize = 0;
+        uint32_t SpecularSize = 0;
+        uint32_t SpecularMipLevels = 0;
+        uint32_t LutFormat = 0;
+        uint32_t LutTexelSize = 0;
+        uint32_t LutSize = 0;
+        uint32_t Reserved = 0;
+        uint64_t PayloadSize = 0;
+        uint64_t PayloadHash = 0;
+    };
+
+    static_assert(sizeof(IblCacheHeader) == 208);
+
+    UINT LevelSize(UINT size, UINT level)
+    {
+        return std::max(size >> level, 1u);
+    }
+
+    uint64_t SpecularBytes(const IblCacheHeader& header)
+    {
+        uint64_t bytes = 0;
+        for (UINT level = 0; level < header.SpecularMipLevels; ++level)
+        {
+            const uint64_t size = LevelSize(header.SpecularSize, level);
+            bytes += size * size * header.SpecularTexelSize;
+        }
+        return bytes * 6;
+    }
+
+    D3D12_SUBRESOURCE_DATA Subresource(const uint8_t* data, UINT size, UINT texelSize)
+    {
+        D3D12_SUBRESOURCE_DATA subresource;
+        subresource.pData = data;
+        subresource.RowPitch = (LONG_PTR)size * texelSize;
+        subresource.SlicePitch = subresource.RowPitch * size;
+        return subresource;
+    }
+}
+
+uint64_t IblCache::Key(std::span<const uint8_t> source, std::span<const uint8_t> settings)
+{
+    uint64_t hash = FileUtil::Hash(source.data(), source.size());
+    return FileUtil::Hash(settings.data(), settings.size(), hash);
+}
+
+bool IblCache::Open(const std::wstring& fileName, uint64_t key, IblBakeData& bake)
+{
+    Close();
+    if (!mFile.Open(fileName) || mFile.Size() < sizeof(IblCacheHeader))
+    {
+        Close();
+        return false;
+    }
+
+    IblCacheHeader header;
+    std::memcpy(&header, mFile.Data(), sizeof(header));
+    const uint64_t specularBytes = SpecularBytes(header);
+    const uint64_t lutBytes = (uint64_t)header.LutSize * header.LutSize * header.LutTexelSize;
+    const uint8_t* payload = mFile.Data() + sizeof(header);
+    if (header.Magic != IblCacheHeader::MagicValue || header.Version != Version || header.Key != key ||
+        header.SpecularMipLevels == 0 || header.SpecularMipLevels > 16 || specularBytes == 0 || lutBytes == 0 ||
+        header.PayloadSize != specularBytes + lutBytes || mFile.Size() != sizeof(header) + header.PayloadSize ||
+        FileUtil::Hash(payload, (size_t)header.PayloadSize) != header.PayloadHash)
+    {
+        Close();
+        return false;
+    }
+
+    std::memcpy(bake.IrradianceSH, header.IrradianceSH, sizeof(header.IrradianceSH));
+
+    bake.SpecularFormat = (DXGI_FORMAT)header.SpecularFormat;
+    bake.SpecularSize = header.SpecularSize;
+    bake.Specular.clear();
+    const uint8_t* data = payload;
+    for (UINT face = 0; face < 6; ++face)
+    {
+        for (UINT level = 0; level < header.SpecularMipLevels; ++level)
+        {
+            bake.Specular.push_back(Subresource(data, LevelSize(header.SpecularSize, level), header.SpecularTexelSize));
+            data += bake.Specular.back().SlicePitch;
+        }
+    }
+
+    bake.LutFormat = (DXGI_FORMAT)header.LutFormat;
+    bake.LutSize = header.LutSize;
+    bake.Lut = Subresource(data, header.LutSize, header.LutTexelSize);
+    return true;
+}
+
+void IblCache::Close()
+{
+    mFile.Close();
+}
+
+bool IblCache::Write(const std::wstring& fileName, uint64_t key, const IblBakeData& bake)
+{
+    if (bake.Specular.empty() || bake.Specular.size() % 6 != 0 || bake.SpecularSize == 0 || bake.LutSize == 0)
+        return false;
+
+    IblCacheHeader header;
+    header.Key = key;
+    std::memcpy(header.IrradianceSH, bake.IrradianceSH, sizeof(header.IrradianceSH));
+    header.SpecularFormat = (uint32_t)bake.SpecularFormat;
+    header.SpecularTexelSize = (uint32_t)(bake.Specular[0].RowPitch / bake.SpecularSize);
+    header.SpecularSize = bake.SpecularSize;
+    header.SpecularMipLevels = (uint32_t)bake.Specular.size() / 6;
+    header.LutFormat = (uint32_t)bake.LutFormat;
+    header.LutTexelSize = (uint32_t)(bake.Lut.RowPitch / bake.LutSize);
+    header.LutSize = bake.LutSize;
+
+    // Rows are written tightly packed, whatever pitch the source has.
+    std::vector<uint8_t> payload;
+    auto append = [&](const D3D12_SUBRESOURCE_DATA& subresource, UINT size, UINT texelSize)
+    {
+        for (UINT y = 0; y < size; ++y)
+        {
+            const uint8_t* row = static_cast<const uint8_t*>(subresource.pData) + subresource.RowPitch * y;
+            payload.insert(payload.end(), row, row + (size_t)size * texelSize);
+        }
+    };
+    for (UINT face = 0; face < 6; ++face)
+    {
+        for (UINT level = 0; level < header.SpecularMipLevels; ++level)
+            append(bake.Specular[(size_t)face * header.SpecularMipLevels + level],
+                LevelSize(bake.SpecularSize, level), header.SpecularTexelSize);
+    }
+    append(bake.Lut, bake.LutSize, header.LutTexelSize);
+
+    header.PayloadSize = payload.size();
+    header.PayloadHash = FileUtil::Hash(payload.data(), payload.size());
+
+    // A crash while saving leaves the previous bake intact.
+    return FileUtil::WriteAtomically(fileName, [&](std::ofstream& file)
+    {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(payload.data()), (std::streamsize)payload.size());
+    });
+}
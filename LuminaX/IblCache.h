@@ -0,0 +1,51 @@
+#pragma once
+#include <DirectXMath.h>
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SphericalHarmonics.h"
+
+// Everything image based lighting bakes from one environment. The texture
+// data points into whoever owns it: the baker's buffers or an open IblCache.
+struct IblBakeData
+{
+    DirectX::XMFLOAT4 IrradianceSH[SphericalHarmonics::CoefficientCount] = {};
+
+    // Six faces with a full chain each, face major.
+    DXGI_FORMAT SpecularFormat = DXGI_FORMAT_UNKNOWN;
+    UINT SpecularSize = 0;
+    std::vector<D3D12_SUBRESOURCE_DATA> Specular;
+
+    DXGI_FORMAT LutFormat = DXGI_FORMAT_UNKNOWN;
+    UINT LutSize = 0;
+    D3D12_SUBRESOURCE_DATA Lut = {};
+};
+
+// On-disk cache of an IblBakeData, so the bakes only run when the
+// environment or the bake settings change.
+//
+// The file is keyed by a hash of the source cube map's bytes and of the
+// settings. It is opened with a single mapping; the textures are used in
+// place from it, as DDS levels are. A hash of the payload guards against
+// truncated or corrupt files.
+class IblCache
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    static uint64_t Key(std::span<const uint8_t> source, std::span<const uint8_t> settings);
+
+    // False if the file is missing, isn't a valid cache file or was baked
+    // for another key. bake points into the mapping while the cache is open.
+    bool Open(const std::wstring& fileName, uint64_t key, IblBakeData& bake);
+    void Close();
+
+    static bool Write(const std::wstring& fileName, uint64_t key, const IblBakeData& bake);
+
+private:
+    MappedFile mFile;
+};
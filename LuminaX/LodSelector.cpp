@@ -0,0 +1,94 @@
+#include "LodSelector.h"
+#include "DemoApp.h"
+#include "Camera.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace DirectX;
+
+LodSelector::LodSelector(const Settings& settings)
+    : mSettings(settings)
+{
+}
+
+LodSelector::Settings& LodSelector::GetSettings()
+{
+    return mSettings;
+}
+
+const LodSelector::Stats& LodSelector::GetStats() const
+{
+    return mStats;
+}
+
+void LodSelector::Select(const Camera& camera, float viewportHeight,
+    const std::vector<RenderItem*>& ritems,
+    std::vector<RenderItem*>& visible)
+{
+    mStats = Stats{};
+    visible.clear();
+    visible.reserve(ritems.size());
+
+    // Pixels covered by one world unit at distance one along the view axis.
+    const float pixelsPerUnitAtOne = 0.5f * viewportHeight / tanf(0.5f * camera.GetFovY());
+    const XMVECTOR eyePos = camera.GetPosition();
+
+    const float cullIn = mSettings.MinPixelRadius * (1.0f + mSettings.Hysteresis);
+    const float cullOut = mSettings.MinPixelRadius * (1.0f - mSettings.Hysteresis);
+
+    for (auto ri : ritems)
+    {
+        BoundingSphere worldBounds;
+        ri->Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri->World));
+
+        float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Center) - eyePos));
+        float pixelRadius = ProjectedPixelRadius(worldBounds.Radius, distance, pixelsPerUnitAtOne);
+
+        // A culled item has to grow past the upper edge of the band to come back.
+        ri->Culled = ri->Culled ? (pixelRadius < cullIn) : (pixelRadius < cullOut);
+        if (ri->Culled)
+        {
+            mStats.CulledItemCount++;
+            continue;
+        }
+
+        if (ri->LodCount > 0)
+        {
+            ri->CurrLod = SelectLod(*ri, pixelRadius);
+
+            const SubmeshGeometry& lod = ri->Lods[ri->CurrLod];
+            ri->IndexCount = lod.IndexCount;
+            ri->StartIndexLocation = lod.StartIndexLocation;
+            ri->BaseVertexLocation = lod.BaseVertexLocation;
+        }
+
+        mStats.LodItemCount[ri->CurrLod]++;
+        visible.push_back(ri);
+    }
+}
+
+float LodSelector::ProjectedPixelRadius(float radius, float distance, float pixelsPerUnitAtOne)
+{
+    // The camera is inside the sphere, treat it as covering the whole screen.
+    if (distance <= radius)
+        return std::numeric_limits<float>::max();
+
+    return radius * pixelsPerUnitAtOne / distance;
+}
+
+UINT LodSelector::SelectLod(const RenderItem& ritem, float pixelRadius) const
+{
+    UINT lod = (ritem.CurrLod < ritem.LodCount) ? ritem.CurrLod : 0;
+    const UINT coarsest = ritem.LodCount - 1;
+
+    // Step towards coarser LODs while the item is clearly below the threshold...
+    while (lod < coarsest && pixelRadius < mSettings.LodPixelRadius[lod] * (1.0f - mSettings.Hysteresis))
+        ++lod;
+
+    // ...and back towards finer LODs while it is clearly above it.
+    while (lod > 0 && pixelRadius > mSettings.LodPixelRadius[lod - 1] * (1.0f + mSettings.Hysteresis))
+        --lod;
+
+    return lod;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "GraphicsUtil.h"
+
+struct RenderItem;
+class Camera;
+
+// Picks a LOD per render item from the projected size of its bounding sphere
+// and drops items that cover too few pixels to be worth drawing.
+class LodSelector
+{
+public:
+    static constexpr UINT MaxLodCount = 3;
+
+    struct Settings
+    {
+        // Projected radius in pixels below which LOD i+1 is used instead of LOD i.
+        std::array<float, MaxLodCount - 1> LodPixelRadius = { 64.0f, 24.0f };
+
+        // Items whose projected radius falls below this are culled.
+        float MinPixelRadius = 1.5f;
+
+        // Relative band around every threshold that has to be crossed before
+        // the selection changes. Keeps items on a boundary from popping.
+        float Hysteresis = 0.15f;
+    };
+
+    struct Stats
+    {
+        std::array<UINT, MaxLodCount> LodItemCount = {};
+        UINT CulledItemCount = 0;
+    };
+
+    LodSelector() = default;
+    explicit LodSelector(const Settings& settings);
+
+    Settings& GetSettings();
+    const Stats& GetStats() const;
+
+    // Updates CurrLod and the draw arguments of every item in ritems and
+    // writes the items that survived culling to visible.
+    void Select(const Camera& camera, float viewportHeight,
+        const std::vector<RenderItem*>& ritems,
+        std::vector<RenderItem*>& visible);
+
+    // Projected radius in pixels of a world-space sphere.
+    static float ProjectedPixelRadius(float radius, float distance, float pixelsPerUnitAtOne);
+
+private:
+    UINT SelectLod(const RenderItem& ritem, float pixelRadius) const;
+
+private:
+    Settings mSettings;
+    Stats mStats;
+};
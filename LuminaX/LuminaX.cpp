@@ -11,6 +11,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     try
     {
         DemoApp theApp;
+        theApp.ParseCommandLine(cmdLine);
+        if (theApp.PackRequested())
+            return theApp.PackAssets() ? 0 : 1;
         if (!theApp.Init(hInstance))
             return 0;
 
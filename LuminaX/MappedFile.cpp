@@ -0,0 +1,88 @@
+#include "MappedFile.h"
+#include <utility>
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+{
+    *this = std::move(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        Close();
+        std::swap(mFile, rhs.mFile);
+        std::swap(mMapping, rhs.mMapping);
+        std::swap(mData, rhs.mData);
+        std::swap(mSize, rhs.mSize);
+    }
+    return *this;
+}
+
+bool MappedFile::Open(const std::wstring& fileName)
+{
+    Close();
+
+    mFile = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+    mSize = static_cast<uint64_t>(size.QuadPart);
+
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData != nullptr)
+        UnmapViewOfFile(mData);
+    if (mMapping != nullptr)
+        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = nullptr;
+    mData = nullptr;
+    mSize = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+    return mData != nullptr;
+}
+
+const uint8_t* MappedFile::Data() const
+{
+    return mData;
+}
+
+uint64_t MappedFile::Size() const
+{
+    return mSize;
+}
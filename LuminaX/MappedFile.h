@@ -0,0 +1,31 @@
+#pragma once
+#include <Windows.h>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. The view stays valid for the
+// lifetime of the object, so data can be used in place without copying.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile& rhs) = delete;
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+    MappedFile(MappedFile&& rhs) noexcept;
+    MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+    bool Open(const std::wstring& fileName);
+    void Close();
+
+    bool IsOpen() const;
+    const uint8_t* Data() const;
+    uint64_t Size() const;
+
+private:
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+    const uint8_t* mData = nullptr;
+    uint64_t mSize = 0;
+};
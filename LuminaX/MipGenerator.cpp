@@ -0,0 +1,334 @@
+#include "MipGenerator.h"
+#include "ParallelFor.h"
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    enum class TexelType
+    {
+        UNorm8,
+        UNorm8Srgb,
+        Half,
+        Float,
+        Unsupported
+    };
+
+    TexelType TypeOf(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+            return TexelType::UNorm8;
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+            return TexelType::UNorm8Srgb;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            return TexelType::Half;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return TexelType::Float;
+        default:
+            return TexelType::Unsupported;
+        }
+    }
+
+    UINT BytesPerTexel(TexelType type)
+    {
+        switch (type)
+        {
+        case TexelType::Half:
+            return 8;
+        case TexelType::Float:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    // Rows per thread below which the passes run on fewer threads.
+    constexpr UINT MinRowsPerThread = 16;
+
+    struct Tap
+    {
+        UINT Index;
+        float Weight;
+    };
+
+    // Source taps of every destination index along one axis; the taps of
+    // destination i are Taps[Offsets[i]] .. Taps[Offsets[i + 1]].
+    struct Kernel
+    {
+        std::vector<UINT> Offsets;
+        std::vector<Tap> Taps;
+    };
+
+    // Half width of the Kaiser filter in destination texels, and its shape.
+    constexpr float KaiserRadius = 3.0f;
+    constexpr float KaiserAlpha = 4.0f;
+
+    float Sinc(float x)
+    {
+        if (std::fabs(x) < 1e-6f)
+            return 1.0f;
+        x *= XM_PI;
+        return std::sin(x) / x;
+    }
+
+    // Modified Bessel function of the first kind, order 0.
+    float BesselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        const float halfX = 0.5f * x;
+        for (int k = 1; k < 32 && term > 1e-8f * sum; ++k)
+        {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    float KaiserWindow(float t)
+    {
+        return BesselI0(KaiserAlpha * std::sqrt(std::max(0.0f, 1.0f - t * t))) / BesselI0(KaiserAlpha);
+    }
+
+    Kernel BuildKernel(UINT srcSize, UINT dstSize, MipGenerator::Filter filter)
+    {
+        Kernel kernel;
+        kernel.Offsets.push_back(0);
+
+        const float scale = (float)srcSize / (float)dstSize;
+        for (UINT x = 0; x < dstSize; ++x)
+        {
+            const size_t first = kernel.Taps.size();
+            if (filter == MipGenerator::Filter::Box || srcSize == dstSize)
+            {
+                // Area weights of the source texels under the destination texel;
+                // odd sizes give fractional footprints at the borders.
+                const float begin = x * scale;
+                const float end = (x + 1) * scale;
+                for (UINT i = (UINT)std::floor(begin); i < srcSize && (float)i < end; ++i)
+                {
+                    float weight = std::min(end, i + 1.0f) - std::max(begin, (float)i);
+                    if (weight > 0.0f)
+                        kernel.Taps.push_back({ i, weight });
+                }
+            }
+            else
+            {
+                // Distances are measured in destination texels, so the sinc
+                // cuts off at the destination's Nyquist frequency. The image
+                // is clamped at the borders.
+                const float center = (x + 0.5f) * scale;
+                const int firstTap = (int)std::floor(center - KaiserRadius * scale);
+                const int lastTap = (int)std::ceil(center + KaiserRadius * scale);
+                for (int i = firstTap; i <= lastTap; ++i)
+                {
+                    float d = (i + 0.5f - center) / scale;
+                    if (std::fabs(d) >= KaiserRadius)
+                        continue;
+
+                    UINT index = (UINT)std::clamp(i, 0, (int)srcSize - 1);
+                    kernel.Taps.push_back({ index, Sinc(d) * KaiserWindow(d / KaiserRadius) });
+                }
+            }
+
+            float sum = 0.0f;
+            for (size_t i = first; i < kernel.Taps.size(); ++i)
+                sum += kernel.Taps[i].Weight;
+            for (size_t i = first; i < kernel.Taps.size(); ++i)
+                kernel.Taps[i].Weight /= sum;
+
+            kernel.Offsets.push_back((UINT)kernel.Taps.size());
+        }
+        return kernel;
+    }
+
+    using Image = std::vector<XMVECTOR>;
+
+    void Decode(TexelType type, const uint8_t* src, size_t rowPitch, UINT width, UINT height, Image& image)
+    {
+        image.resize((size_t)width * height);
+        ParallelFor(height, MinRowsPerThread, [&](UINT begin, UINT end)
+        {
+            for (UINT y = begin; y < end; ++y)
+            {
+                const uint8_t* row = src + rowPitch * y;
+                XMVECTOR* dest = &image[(size_t)width * y];
+                for (UINT x = 0; x < width; ++x)
+                {
+                    switch (type)
+                    {
+                    case TexelType::UNorm8:
+                        dest[x] = XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(row) + x);
+                        break;
+                    case TexelType::UNorm8Srgb:
+                        dest[x] = XMColorSRGBToRGB(XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(row) + x));
+                        break;
+                    case TexelType::Half:
+                        dest[x] = XMLoadHalf4(reinterpret_cast<const XMHALF4*>(row) + x);
+                        break;
+                    default:
+                        dest[x] = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row) + x);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    void Encode(TexelType type, const Image& image, UINT width, UINT height, uint8_t* dest, size_t rowPitch)
+    {
+        ParallelFor(height, MinRowsPerThread, [&](UINT begin, UINT end)
+        {
+            for (UINT y = begin; y < end; ++y)
+            {
+                uint8_t* row = dest + rowPitch * y;
+                const XMVECTOR* src = &image[(size_t)width * y];
+                for (UINT x = 0; x < width; ++x)
+                {
+                    switch (type)
+                    {
+                    case TexelType::UNorm8:
+                        XMStoreUByteN4(reinterpret_cast<XMUBYTEN4*>(row) + x, src[x]);
+                        break;
+                    case TexelType::UNorm8Srgb:
+                        // The Kaiser lobes can overshoot; clamp before the sRGB curve.
+                        XMStoreUByteN4(reinterpret_cast<XMUBYTEN4*>(row) + x, XMColorRGBToSRGB(XMVectorSaturate(src[x])));
+                        break;
+                    case TexelType::Half:
+                        XMStoreHalf4(reinterpret_cast<XMHALF4*>(row) + x, src[x]);
+                        break;
+                    default:
+                        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(row) + x, src[x]);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    void Downsample(const Image& src, UINT srcWidth, UINT srcHeight,
+        Image& dest, UINT destWidth, UINT destHeight, MipGenerator::Filter filter)
+    {
+        const Kernel kernelX = BuildKernel(srcWidth, destWidth, filter);
+        const Kernel kernelY = BuildKernel(srcHeight, destHeight, filter);
+
+        // Horizontal pass: srcHeight rows of destWidth texels.
+        Image temp((size_t)destWidth * srcHeight);
+        ParallelFor(srcHeight, MinRowsPerThread, [&](UINT begin, UINT end)
+        {
+            for (UINT y = begin; y < end; ++y)
+            {
+                const XMVECTOR* row = &src[(size_t)srcWidth * y];
+                XMVECTOR* out = &temp[(size_t)destWidth * y];
+                for (UINT x = 0; x < destWidth; ++x)
+                {
+                    XMVECTOR sum = XMVectorZero();
+                    for (UINT t = kernelX.Offsets[x]; t < kernelX.Offsets[x + 1]; ++t)
+                        sum = XMVectorMultiplyAdd(XMVectorReplicate(kernelX.Taps[t].Weight), row[kernelX.Taps[t].Index], sum);
+                    out[x] = sum;
+                }
+            }
+        });
+
+        // Vertical pass; whole rows are accumulated to stay cache friendly.
+        dest.resize((size_t)destWidth * destHeight);
+        ParallelFor(destHeight, MinRowsPerThread, [&](UINT begin, UINT end)
+        {
+            for (UINT y = begin; y < end; ++y)
+            {
+                XMVECTOR* out = &dest[(size_t)destWidth * y];
+                std::fill(out, out + destWidth, XMVectorZero());
+                for (UINT t = kernelY.Offsets[y]; t < kernelY.Offsets[y + 1]; ++t)
+                {
+                    const XMVECTOR weight = XMVectorReplicate(kernelY.Taps[t].Weight);
+                    const XMVECTOR* row = &temp[(size_t)destWidth * kernelY.Taps[t].Index];
+                    for (UINT x = 0; x < destWidth; ++x)
+                        out[x] = XMVectorMultiplyAdd(weight, row[x], out[x]);
+                }
+            }
+        });
+    }
+}
+
+bool MipGenerator::IsSupported(DXGI_FORMAT format)
+{
+    return TypeOf(format) != TexelType::Unsupported;
+}
+
+UINT MipGenerator::FullMipCount(UINT width, UINT height)
+{
+    UINT count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        count++;
+    }
+    return count;
+}
+
+void MipGenerator::Generate(DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels,
+    const void* top, size_t topRowPitch, Filter filter,
+    std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+    const TexelType type = TypeOf(format);
+    assert(type != TexelType::Unsupported);
+    mipLevels = std::clamp(mipLevels, 1u, FullMipCount(width, height));
+    const UINT texelSize = BytesPerTexel(type);
+
+    std::vector<size_t> offsets(mipLevels);
+    size_t totalBytes = 0;
+    for (UINT i = 0; i < mipLevels; ++i)
+    {
+        offsets[i] = totalBytes;
+        totalBytes += (size_t)std::max(width >> i, 1u) * std::max(height >> i, 1u) * texelSize;
+    }
+
+    data = std::make_unique<uint8_t[]>(totalBytes);
+    subresources.resize(mipLevels);
+    for (UINT i = 0; i < mipLevels; ++i)
+    {
+        const size_t rowPitch = (size_t)std::max(width >> i, 1u) * texelSize;
+        subresources[i].pData = data.get() + offsets[i];
+        subresources[i].RowPitch = (LONG_PTR)rowPitch;
+        subresources[i].SlicePitch = (LONG_PTR)(rowPitch * std::max(height >> i, 1u));
+    }
+
+    const size_t rowBytes = (size_t)width * texelSize;
+    for (UINT y = 0; y < height; ++y)
+        std::memcpy(data.get() + rowBytes * y, static_cast<const uint8_t*>(top) + topRowPitch * y, rowBytes);
+
+    if (mipLevels == 1)
+        return;
+
+    // Each level is filtered from the previous float level, not from the
+    // quantized one.
+    Image level;
+    Image next;
+    Decode(type, static_cast<const uint8_t*>(top), topRowPitch, width, height, level);
+
+    UINT levelWidth = width;
+    UINT levelHeight = height;
+    for (UINT i = 1; i < mipLevels; ++i)
+    {
+        const UINT nextWidth = std::max(levelWidth / 2, 1u);
+        const UINT nextHeight = std::max(levelHeight / 2, 1u);
+        Downsample(level, levelWidth, levelHeight, next, nextWidth, nextHeight, filter);
+        Encode(type, next, nextWidth, nextHeight, data.get() + offsets[i], (size_t)subresources[i].RowPitch);
+
+        std::swap(level, next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Builds mip chains on the CPU for textures that come without one (PNG, JPG
+// and other WIC formats).
+//
+// Texels are filtered as four floats in DirectXMath vectors, so every tap is
+// a single SIMD multiply-add. 8 bit sRGB formats are converted to linear
+// before filtering and back afterwards. Each level is filtered separably
+// from the previous, already filtered level, with the rows of each pass
+// split across threads.
+class MipGenerator
+{
+public:
+    enum class Filter
+    {
+        Box,
+        // Windowed sinc (Kaiser window); sharper than Box without ringing much.
+        Kaiser
+    };
+
+    // RGBA8/BGRA8 (UNORM and UNORM_SRGB), RGBA16F and RGBA32F.
+    static bool IsSupported(DXGI_FORMAT format);
+
+    static UINT FullMipCount(UINT width, UINT height);
+
+    // Generates mipLevels levels from the top level. data receives all levels
+    // tightly packed, the top one included, and subresources point into it.
+    static void Generate(DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels,
+        const void* top, size_t topRowPitch, Filter filter,
+        std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources);
+};
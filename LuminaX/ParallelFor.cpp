@@ -0,0 +1,139 @@
+#include "ParallelFor.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // One ParallelFor call. Chunks are claimed through Next by the caller
+    // and by any pool thread that picks the job up.
+    struct Job
+    {
+        const std::function<void(uint32_t)>* Chunk = nullptr;
+        uint32_t ChunkCount = 0;
+        std::atomic<uint32_t> Next = 0;
+
+        std::mutex Mutex;
+        std::condition_variable Finished;
+        uint32_t DoneCount = 0;
+
+        // Runs chunks until none are left; false if there was none to claim.
+        bool Work()
+        {
+            bool worked = false;
+            uint32_t done = 0;
+            for (uint32_t i = Next++; i < ChunkCount; i = Next++)
+            {
+                (*Chunk)(i);
+                ++done;
+                worked = true;
+            }
+
+            if (done > 0)
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                DoneCount += done;
+                if (DoneCount == ChunkCount)
+                    Finished.notify_all();
+            }
+            return worked;
+        }
+    };
+
+    thread_local bool tIsPoolThread = false;
+
+    class ThreadPool
+    {
+    public:
+        ThreadPool()
+        {
+            const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+            for (uint32_t i = 0; i < threadCount; ++i)
+                mThreads.emplace_back([this] { WorkerLoop(); });
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+            }
+            mWake.notify_all();
+            for (auto& thread : mThreads)
+                thread.join();
+        }
+
+        void Run(const std::shared_ptr<Job>& job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mJobs.push_back(job);
+            }
+            // The caller takes one chunk itself.
+            const uint32_t helpers = std::min<uint32_t>(job->ChunkCount - 1, (uint32_t)mThreads.size());
+            for (uint32_t i = 0; i < helpers; ++i)
+                mWake.notify_one();
+
+            job->Work();
+
+            std::unique_lock<std::mutex> lock(job->Mutex);
+            job->Finished.wait(lock, [&] { return job->DoneCount == job->ChunkCount; });
+        }
+
+    private:
+        void WorkerLoop()
+        {
+            tIsPoolThread = true;
+            for (;;)
+            {
+                std::shared_ptr<Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mWake.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+                    if (mStopping)
+                        return;
+
+                    // Jobs stay queued until a thread finds no chunk left
+                    // in them, so every free thread can help with the oldest.
+                    job = mJobs.front();
+                }
+
+                if (!job->Work())
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    if (!mJobs.empty() && mJobs.front() == job)
+                        mJobs.pop_front();
+                }
+            }
+        }
+
+    private:
+        std::vector<std::thread> mThreads;
+        std::deque<std::shared_ptr<Job>> mJobs;
+        std::mutex mMutex;
+        std::condition_variable mWake;
+        bool mStopping = false;
+    };
+}
+
+void RunParallelChunks(uint32_t chunkCount, const std::function<void(uint32_t)>& chunk)
+{
+    // Nested calls stay on the pool thread that made them; waiting for
+    // other pool threads from here could leave none to run the chunks.
+    if (tIsPoolThread || chunkCount <= 1)
+    {
+        for (uint32_t i = 0; i < chunkCount; ++i)
+            chunk(i);
+        return;
+    }
+
+    static ThreadPool pool;
+
+    auto job = std::make_shared<Job>();
+    job->Chunk = &chunk;
+    job->ChunkCount = chunkCount;
+    pool.Run(job);
+}
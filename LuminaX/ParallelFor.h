@@ -0,0 +1,35 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Runs chunk(i) for every i in [0, chunkCount) on the shared worker pool and
+// the calling thread, and returns once all of them are done. The pool's
+// threads are created once, one per core besides the caller's, and are
+// shared by every caller, so loader threads calling this at the same time
+// queue up instead of each starting threads of their own. Called from a
+// pool thread, it runs the chunks inline.
+void RunParallelChunks(uint32_t chunkCount, const std::function<void(uint32_t)>& chunk);
+
+// Calls fn(begin, end) on contiguous chunks of [0, count), one chunk per core,
+// and returns once all of them are done. Counts below minPerThread per core
+// use fewer threads, down to running inline on the caller.
+template<typename Fn>
+void ParallelFor(uint32_t count, uint32_t minPerThread, const Fn& fn)
+{
+    uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::min(threadCount, (count + minPerThread - 1) / minPerThread);
+    if (threadCount <= 1)
+    {
+        fn(0u, count);
+        return;
+    }
+
+    const uint32_t chunk = (count + threadCount - 1) / threadCount;
+    const uint32_t chunkCount = (count + chunk - 1) / chunk;
+    RunParallelChunks(chunkCount, [&](uint32_t i)
+    {
+        fn(i * chunk, std::min(count, (i + 1) * chunk));
+    });
+}
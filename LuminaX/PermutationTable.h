@@ -0,0 +1,78 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+
+// Lazily created variants of something, one per combination of up to a few
+// feature bits. A permutation key is the bitmask of enabled features and
+// indexes the table directly, so a lookup costs no hashing or string
+// compares. A variant is created on a worker thread the first time it is
+// asked for; Get waits for it, TryGet and Prefetch don't.
+//
+// Exceptions thrown by create are rethrown by Get and TryGet.
+template<typename T>
+class PermutationTable
+{
+public:
+    using CreateFn = std::function<T(uint32_t key)>;
+
+    PermutationTable(uint32_t featureCount, CreateFn create)
+        : mCreate(std::move(create)), mEntries(size_t(1) << featureCount)
+    {
+    }
+
+    ~PermutationTable()
+    {
+        // Running creates still refer to mCreate.
+        for (auto& entry : mEntries)
+        {
+            if (entry.valid())
+                entry.wait();
+        }
+    }
+
+    PermutationTable(const PermutationTable& rhs) = delete;
+    PermutationTable& operator=(const PermutationTable& rhs) = delete;
+
+    uint32_t Count() const
+    {
+        return (uint32_t)mEntries.size();
+    }
+
+    void Prefetch(uint32_t key)
+    {
+        Start(key);
+    }
+
+    const T& Get(uint32_t key)
+    {
+        return Start(key).get();
+    }
+
+    // Null while the variant is still being created.
+    const T* TryGet(uint32_t key)
+    {
+        const std::shared_future<T>& entry = Start(key);
+        if (entry.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return nullptr;
+        return &entry.get();
+    }
+
+private:
+    const std::shared_future<T>& Start(uint32_t key)
+    {
+        std::lock_guard lock(mMutex);
+        std::shared_future<T>& entry = mEntries.at(key);
+        if (!entry.valid())
+            entry = std::async(std::launch::async, mCreate, key).share();
+        return entry;
+    }
+
+    CreateFn mCreate;
+    std::mutex mMutex;
+    // Entries are only ever assigned once, so references to them stay valid.
+    std::vector<std::shared_future<T>> mEntries;
+};
@@ -0,0 +1,72 @@
+#include "PipelineCache.h"
+#include "GraphicsUtil.h"
+#include "PipelineCacheFile.h"
+
+using Microsoft::WRL::ComPtr;
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& fileName)
+    : md3dDevice(device), mFileName(fileName)
+{
+    ComPtr<ID3D12Device1> device1;
+    if (FAILED(device->QueryInterface(IID_PPV_ARGS(&device1))))
+        return;
+
+    // A library serialized by another driver or adapter is rejected; the
+    // pipelines are then compiled again into an empty one.
+    if (PipelineCacheFile::Read(mFileName, mLibraryData) &&
+        SUCCEEDED(device1->CreatePipelineLibrary(mLibraryData.data(), mLibraryData.size(), IID_PPV_ARGS(&mLibrary))))
+        return;
+
+    mLibraryData.clear();
+    if (FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+        mLibrary = nullptr;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphics(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+    std::span<const uint8_t> rootSignature)
+{
+    ComPtr<ID3D12PipelineState> pso;
+    const std::wstring name = PipelineCacheFile::Name(PipelineCacheFile::Key(desc, rootSignature));
+    if (mLibrary != nullptr && SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+        return pso;
+
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+    if (mLibrary != nullptr && SUCCEEDED(mLibrary->StorePipeline(name.c_str(), pso.Get())))
+        mChanged = true;
+    return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateCompute(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+    std::span<const uint8_t> rootSignature)
+{
+    ComPtr<ID3D12PipelineState> pso;
+    const std::wstring name = PipelineCacheFile::Name(PipelineCacheFile::Key(desc, rootSignature));
+    if (mLibrary != nullptr && SUCCEEDED(mLibrary->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+        return pso;
+
+    ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+    if (mLibrary != nullptr && SUCCEEDED(mLibrary->StorePipeline(name.c_str(), pso.Get())))
+        mChanged = true;
+    return pso;
+}
+
+bool PipelineCache::Save()
+{
+    if (mLibrary == nullptr)
+        return true;
+
+    // Each save serializes and writes under the lock, so the snapshot taken
+    // last is also the one written last. Pipelines stored while this
+    // serializes mark the library changed again for the next save.
+    std::lock_guard lock(mSaveMutex);
+    if (!mChanged.exchange(false))
+        return true;
+
+    std::vector<uint8_t> data(mLibrary->GetSerializedSize());
+    if (FAILED(mLibrary->Serialize(data.data(), data.size())) || !PipelineCacheFile::Write(mFileName, data))
+    {
+        mChanged = true;
+        return false;
+    }
+    return true;
+}
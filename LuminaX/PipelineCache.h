@@ -0,0 +1,45 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+// Persistent pipeline states, kept in an ID3D12PipelineLibrary that is saved
+// to disk. Pipelines are stored under PipelineCacheFile::Key, so a changed
+// shader, state or root signature simply misses.
+//
+// Everything the driver may reject degrades to creating the PSO from scratch:
+// a library from another driver or adapter starts an empty one, an entry
+// that fails to load is created and stored again, and a device without
+// pipeline library support creates every PSO directly.
+class PipelineCache
+{
+public:
+    PipelineCache(ID3D12Device* device, const std::wstring& fileName);
+
+    PipelineCache(const PipelineCache& rhs) = delete;
+    PipelineCache& operator=(const PipelineCache& rhs) = delete;
+
+    // Thread safe, except that two threads must not create the same pipeline
+    // at the same time. rootSignature is desc.pRootSignature serialized.
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateGraphics(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+        std::span<const uint8_t> rootSignature);
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateCompute(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+        std::span<const uint8_t> rootSignature);
+
+    // Writes the library if pipelines were added to it. Thread safe: saves
+    // run one at a time, so a later save never loses to an older snapshot.
+    bool Save();
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    std::wstring mFileName;
+    // The library refers to the data it was created from.
+    std::vector<uint8_t> mLibraryData;
+    Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+    std::atomic<bool> mChanged = false;
+    std::mutex mSaveMutex;
+};
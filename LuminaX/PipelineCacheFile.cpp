@@ -0,0 +1,240 @@
+#include "PipelineCacheFile.h"
+#include "FileUtil.h"
+#include <cstring>
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+namespace
+{
+    struct PipelineCacheHeader
+    {
+        static constexpr uint32_t MagicValue = 0x4C50584C; // "LXPL"
+
+        uint32_t Magic = MagicValue;
+        uint32_t Version = PipelineCacheFile::Version;
+        uint64_t LibrarySize = 0;
+        uint64_t LibraryHash = 0;
+    };
+
+    static_assert(sizeof(PipelineCacheHeader) == 24);
+
+    // Hashes descriptions field by field. Variable length data is preceded
+    // by its length, so neighbouring fields can't run into each other.
+    class Hasher
+    {
+    public:
+        template<typename T>
+        void Value(T value)
+        {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+            mHash = FileUtil::Hash(&value, sizeof(value), mHash);
+        }
+
+        void Bytes(const void* data, size_t size)
+        {
+            Value((uint64_t)size);
+            if (data != nullptr)
+                mHash = FileUtil::Hash(data, size, mHash);
+        }
+
+        void String(const char* text)
+        {
+            Bytes(text, text != nullptr ? strlen(text) : 0);
+        }
+
+        void Bytecode(const D3D12_SHADER_BYTECODE& bytecode)
+        {
+            Bytes(bytecode.pShaderBytecode, bytecode.pShaderBytecode != nullptr ? bytecode.BytecodeLength : 0);
+        }
+
+        void Blend(const D3D12_BLEND_DESC& blend)
+        {
+            Value(blend.AlphaToCoverageEnable);
+            Value(blend.IndependentBlendEnable);
+            for (const auto& target : blend.RenderTarget)
+            {
+                Value(target.BlendEnable);
+                Value(target.LogicOpEnable);
+                Value(target.SrcBlend);
+                Value(target.DestBlend);
+                Value(target.BlendOp);
+                Value(target.SrcBlendAlpha);
+                Value(target.DestBlendAlpha);
+                Value(target.BlendOpAlpha);
+                Value(target.LogicOp);
+                Value(target.RenderTargetWriteMask);
+            }
+        }
+
+        void Rasterizer(const D3D12_RASTERIZER_DESC& rasterizer)
+        {
+            Value(rasterizer.FillMode);
+            Value(rasterizer.CullMode);
+            Value(rasterizer.FrontCounterClockwise);
+            Value(rasterizer.DepthBias);
+            Value(rasterizer.DepthBiasClamp);
+            Value(rasterizer.SlopeScaledDepthBias);
+            Value(rasterizer.DepthClipEnable);
+            Value(rasterizer.MultisampleEnable);
+            Value(rasterizer.AntialiasedLineEnable);
+            Value(rasterizer.ForcedSampleCount);
+            Value(rasterizer.ConservativeRaster);
+        }
+
+        void StencilOp(const D3D12_DEPTH_STENCILOP_DESC& op)
+        {
+            Value(op.StencilFailOp);
+            Value(op.StencilDepthFailOp);
+            Value(op.StencilPassOp);
+            Value(op.StencilFunc);
+        }
+
+        void DepthStencil(const D3D12_DEPTH_STENCIL_DESC& depthStencil)
+        {
+            Value(depthStencil.DepthEnable);
+            Value(depthStencil.DepthWriteMask);
+            Value(depthStencil.DepthFunc);
+            Value(depthStencil.StencilEnable);
+            Value(depthStencil.StencilReadMask);
+            Value(depthStencil.StencilWriteMask);
+            StencilOp(depthStencil.FrontFace);
+            StencilOp(depthStencil.BackFace);
+        }
+
+        void InputLayout(const D3D12_INPUT_LAYOUT_DESC& layout)
+        {
+            const UINT count = layout.pInputElementDescs != nullptr ? layout.NumElements : 0;
+            Value(count);
+            for (UINT i = 0; i < count; ++i)
+            {
+                const auto& element = layout.pInputElementDescs[i];
+                String(element.SemanticName);
+                Value(element.SemanticIndex);
+                Value(element.Format);
+                Value(element.InputSlot);
+                Value(element.AlignedByteOffset);
+                Value(element.InputSlotClass);
+                Value(element.InstanceDataStepRate);
+            }
+        }
+
+        void StreamOutput(const D3D12_STREAM_OUTPUT_DESC& streamOutput)
+        {
+            const UINT count = streamOutput.pSODeclaration != nullptr ? streamOutput.NumEntries : 0;
+            Value(count);
+            for (UINT i = 0; i < count; ++i)
+            {
+                const auto& entry = streamOutput.pSODeclaration[i];
+                Value(entry.Stream);
+                String(entry.SemanticName);
+                Value(entry.SemanticIndex);
+                Value(entry.StartComponent);
+                Value(entry.ComponentCount);
+                Value(entry.OutputSlot);
+            }
+            const UINT strides = streamOutput.pBufferStrides != nullptr ? streamOutput.NumStrides : 0;
+            Bytes(streamOutput.pBufferStrides, strides * sizeof(UINT));
+            Value(streamOutput.RasterizedStream);
+        }
+
+        uint64_t Result() const
+        {
+            return mHash;
+        }
+
+    private:
+        uint64_t mHash = FileUtil::HashBasis;
+    };
+}
+
+uint64_t PipelineCacheFile::Key(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, std::span<const uint8_t> rootSignature)
+{
+    Hasher hasher;
+    hasher.Value(Version);
+    hasher.Value((uint32_t)D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VS);
+    hasher.Bytes(rootSignature.data(), rootSignature.size());
+    hasher.Bytecode(desc.VS);
+    hasher.Bytecode(desc.PS);
+    hasher.Bytecode(desc.DS);
+    hasher.Bytecode(desc.HS);
+    hasher.Bytecode(desc.GS);
+    hasher.StreamOutput(desc.StreamOutput);
+    hasher.Blend(desc.BlendState);
+    hasher.Value(desc.SampleMask);
+    hasher.Rasterizer(desc.RasterizerState);
+    hasher.DepthStencil(desc.DepthStencilState);
+    hasher.InputLayout(desc.InputLayout);
+    hasher.Value(desc.IBStripCutValue);
+    hasher.Value(desc.PrimitiveTopologyType);
+    hasher.Value(desc.NumRenderTargets);
+    for (DXGI_FORMAT format : desc.RTVFormats)
+        hasher.Value(format);
+    hasher.Value(desc.DSVFormat);
+    hasher.Value(desc.SampleDesc.Count);
+    hasher.Value(desc.SampleDesc.Quality);
+    hasher.Value(desc.NodeMask);
+    hasher.Value(desc.Flags);
+    return hasher.Result();
+}
+
+uint64_t PipelineCacheFile::Key(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, std::span<const uint8_t> rootSignature)
+{
+    Hasher hasher;
+    hasher.Value(Version);
+    hasher.Value((uint32_t)D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_CS);
+    hasher.Bytes(rootSignature.data(), rootSignature.size());
+    hasher.Bytecode(desc.CS);
+    hasher.Value(desc.NodeMask);
+    hasher.Value(desc.Flags);
+    return hasher.Result();
+}
+
+std::wstring PipelineCacheFile::Name(uint64_t key)
+{
+    wchar_t name[17];
+    swprintf(name, sizeof(name) / sizeof(name[0]), L"%016llx", (unsigned long long)key);
+    return name;
+}
+
+bool PipelineCacheFile::Read(const std::wstring& fileName, std::vector<uint8_t>& library)
+{
+    const std::filesystem::path path(fileName);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    PipelineCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.Magic != PipelineCacheHeader::MagicValue || header.Version != Version)
+        return false;
+
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize != sizeof(header) + header.LibrarySize)
+        return false;
+
+    library.resize((size_t)header.LibrarySize);
+    if (!file.read(reinterpret_cast<char*>(library.data()), (std::streamsize)library.size()) ||
+        FileUtil::Hash(library.data(), library.size()) != header.LibraryHash)
+    {
+        library.clear();
+        return false;
+    }
+    return true;
+}
+
+bool PipelineCacheFile::Write(const std::wstring& fileName, std::span<const uint8_t> library)
+{
+    PipelineCacheHeader header;
+    header.LibrarySize = library.size();
+    header.LibraryHash = FileUtil::Hash(library.data(), library.size());
+
+    // A crash while saving leaves the previous library intact.
+    return FileUtil::WriteAtomically(fileName, [&](std::ofstream& file)
+    {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(library.data()), (std::streamsize)library.size());
+    });
+}
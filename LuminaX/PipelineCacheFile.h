@@ -0,0 +1,32 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// The parts of the pipeline cache that don't need a device: the keys that
+// pipelines are stored under and the file the serialized library lives in.
+//
+// A key hashes everything the driver compiles into the PSO: the serialized
+// root signature, the shader bytecode and every state, format and input
+// element of the description. pRootSignature and CachedPSO are pointers and
+// are left out, padding is never hashed.
+//
+// The file is a small header with a hash of the library blob, so a
+// truncated or corrupt file is never handed to the driver.
+class PipelineCacheFile
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    static uint64_t Key(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, std::span<const uint8_t> rootSignature);
+    static uint64_t Key(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, std::span<const uint8_t> rootSignature);
+
+    // Name a pipeline with key is stored under in the library.
+    static std::wstring Name(uint64_t key);
+
+    // False if the file is missing or isn't a valid cache file.
+    static bool Read(const std::wstring& fileName, std::vector<uint8_t>& library);
+    static bool Write(const std::wstring& fileName, std::span<const uint8_t> library);
+};
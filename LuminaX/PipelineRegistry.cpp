@@ -0,0 +1,41 @@
+#include "PipelineRegistry.h"
+#include <mutex>
+
+PipelineRegistry::~PipelineRegistry()
+{
+    // Pending builds still refer to this registry.
+    for (auto& pending : mPending)
+        pending.wait();
+}
+
+void PipelineRegistry::Build(const std::string& name, CreateFn create)
+{
+    mPending.push_back(std::async(std::launch::async, [this, name, create = std::move(create)]()
+    {
+        Publish(name, create());
+    }));
+}
+
+void PipelineRegistry::Wait()
+{
+    // Every build is waited for before one of them is allowed to throw.
+    std::vector<std::future<void>> pending = std::move(mPending);
+    mPending.clear();
+    for (auto& build : pending)
+        build.wait();
+    for (auto& build : pending)
+        build.get();
+}
+
+void PipelineRegistry::Publish(const std::string& name, Microsoft::WRL::ComPtr<ID3D12PipelineState> pso)
+{
+    std::unique_lock lock(mMutex);
+    mPipelines[name] = std::move(pso);
+}
+
+ID3D12PipelineState* PipelineRegistry::Get(const std::string& name) const
+{
+    std::shared_lock lock(mMutex);
+    auto it = mPipelines.find(name);
+    return it != mPipelines.end() ? it->second.Get() : nullptr;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <functional>
+#include <future>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Named pipeline states that may be built on worker threads. Build runs its
+// create function asynchronously and publishes the result under the name, so
+// PSOs become available as they finish. Get may be called from any thread,
+// Build and Wait only from the one that owns the registry.
+class PipelineRegistry
+{
+public:
+    using CreateFn = std::function<Microsoft::WRL::ComPtr<ID3D12PipelineState>()>;
+
+    PipelineRegistry() = default;
+    ~PipelineRegistry();
+
+    PipelineRegistry(const PipelineRegistry& rhs) = delete;
+    PipelineRegistry& operator=(const PipelineRegistry& rhs) = delete;
+
+    void Build(const std::string& name, CreateFn create);
+
+    // Waits for every pending Build and rethrows the first exception one of
+    // them threw.
+    void Wait();
+
+    void Publish(const std::string& name, Microsoft::WRL::ComPtr<ID3D12PipelineState> pso);
+
+    // Null while the PSO isn't built (yet).
+    ID3D12PipelineState* Get(const std::string& name) const;
+
+private:
+    mutable std::shared_mutex mMutex;
+    std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPipelines;
+    std::vector<std::future<void>> mPending;
+};
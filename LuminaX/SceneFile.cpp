@@ -0,0 +1,120 @@
+#include "SceneFile.h"
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    constexpr uint64_t SectionAlignment = 64;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool SectionFits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t fileSize)
+    {
+        if (offset % SectionAlignment != 0 || offset > fileSize)
+            return false;
+        return count <= (fileSize - offset) / stride;
+    }
+}
+
+bool SceneFile::Open(const std::wstring& fileName, uint32_t contentVersion)
+{
+    Close();
+
+    if (!mFile.Open(fileName))
+        return false;
+
+    if (mFile.Size() < sizeof(SceneFileHeader))
+    {
+        Close();
+        return false;
+    }
+
+    auto header = reinterpret_cast<const SceneFileHeader*>(mFile.Data());
+    bool valid = header->Magic == SceneFileHeader::MagicValue &&
+        header->Version == SceneFileHeader::CurrentVersion &&
+        header->HeaderSize == sizeof(SceneFileHeader) &&
+        header->ContentVersion == contentVersion &&
+        header->FileSize == mFile.Size() &&
+        SectionFits(header->MaterialOffset, header->MaterialCount, sizeof(SceneMaterialRecord), mFile.Size()) &&
+        SectionFits(header->GeometryRefOffset, header->GeometryRefCount, sizeof(SceneGeometryRef), mFile.Size()) &&
+        SectionFits(header->RenderItemOffset, header->RenderItemCount, sizeof(SceneRenderItemRecord), mFile.Size());
+
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    mHeader = header;
+    return true;
+}
+
+void SceneFile::Close()
+{
+    mHeader = nullptr;
+    mFile.Close();
+}
+
+std::span<const SceneMaterialRecord> SceneFile::Materials() const
+{
+    if (mHeader == nullptr)
+        return {};
+    return { reinterpret_cast<const SceneMaterialRecord*>(mFile.Data() + mHeader->MaterialOffset), mHeader->MaterialCount };
+}
+
+std::span<const SceneGeometryRef> SceneFile::GeometryRefs() const
+{
+    if (mHeader == nullptr)
+        return {};
+    return { reinterpret_cast<const SceneGeometryRef*>(mFile.Data() + mHeader->GeometryRefOffset), mHeader->GeometryRefCount };
+}
+
+std::span<const SceneRenderItemRecord> SceneFile::RenderItems() const
+{
+    if (mHeader == nullptr)
+        return {};
+    return { reinterpret_cast<const SceneRenderItemRecord*>(mFile.Data() + mHeader->RenderItemOffset),
+        static_cast<size_t>(mHeader->RenderItemCount) };
+}
+
+bool SceneFile::Write(const std::wstring& fileName, uint32_t contentVersion,
+    std::span<const SceneMaterialRecord> materials,
+    std::span<const SceneGeometryRef> geometryRefs,
+    std::span<const SceneRenderItemRecord> renderItems)
+{
+    SceneFileHeader header;
+    header.ContentVersion = contentVersion;
+    header.MaterialCount = (uint32_t)materials.size();
+    header.GeometryRefCount = (uint32_t)geometryRefs.size();
+    header.RenderItemCount = renderItems.size();
+
+    header.MaterialOffset = AlignUp(sizeof(SceneFileHeader), SectionAlignment);
+    header.GeometryRefOffset = AlignUp(header.MaterialOffset + materials.size_bytes(), SectionAlignment);
+    header.RenderItemOffset = AlignUp(header.GeometryRefOffset + geometryRefs.size_bytes(), SectionAlignment);
+    header.FileSize = header.RenderItemOffset + renderItems.size_bytes();
+
+    std::filesystem::path path(fileName);
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    const char zeros[SectionAlignment] = {};
+    auto writeSection = [&](uint64_t offset, const void* data, size_t byteSize)
+    {
+        file.write(zeros, (std::streamsize)(offset - (uint64_t)file.tellp()));
+        file.write(static_cast<const char*>(data), (std::streamsize)byteSize);
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(header.MaterialOffset, materials.data(), materials.size_bytes());
+    writeSection(header.GeometryRefOffset, geometryRefs.data(), geometryRefs.size_bytes());
+    writeSection(header.RenderItemOffset, renderItems.data(), renderItems.size_bytes());
+
+    return file.good();
+}
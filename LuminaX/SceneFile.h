@@ -0,0 +1,103 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+//
+// Binary scene layout (all little endian, every section 64 byte aligned):
+//
+//   SceneFileHeader
+//   SceneMaterialRecord[MaterialCount]
+//   SceneGeometryRef[GeometryRefCount]
+//   SceneRenderItemRecord[RenderItemCount]
+//
+// Records are fixed size PODs so the file can be used straight from a memory
+// mapping. Render items refer to materials and geometry by index, which lets
+// a loader resolve the small material/geometry tables once and then fix up
+// every item with plain array lookups.
+//
+struct SceneFileHeader
+{
+    static constexpr uint32_t MagicValue = 0x4353584C; // "LXSC"
+    static constexpr uint32_t CurrentVersion = 1;
+
+    uint32_t Magic = MagicValue;
+    uint32_t Version = CurrentVersion;
+    uint32_t HeaderSize = sizeof(SceneFileHeader);
+    // Version of the code that built the scene, chosen by the writer.
+    uint32_t ContentVersion = 0;
+    uint64_t FileSize = 0;
+
+    uint32_t MaterialCount = 0;
+    uint32_t GeometryRefCount = 0;
+    uint64_t RenderItemCount = 0;
+
+    uint64_t MaterialOffset = 0;
+    uint64_t GeometryRefOffset = 0;
+    uint64_t RenderItemOffset = 0;
+};
+
+struct SceneMaterialRecord
+{
+    char Name[32] = {};
+    char DiffuseTexture[32] = {};  // texture name, empty when untextured
+    DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+    DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+    float Roughness = 0.25f;
+    DirectX::XMFLOAT4X4 MatTransform;
+};
+
+struct SceneGeometryRef
+{
+    char Geometry[32] = {};
+    char Submesh[32] = {};  // LOD 0 name, "<Submesh>_lod<i>" are picked up automatically
+};
+
+struct SceneRenderItemRecord
+{
+    DirectX::XMFLOAT4X4 World;
+    DirectX::XMFLOAT4X4 TexTransform;
+    uint32_t MaterialIndex = 0;
+    uint32_t GeometryRefIndex = 0;
+    uint32_t Layer = 0;
+    uint32_t Pad = 0;
+};
+
+static_assert(sizeof(SceneFileHeader) == 64);
+static_assert(sizeof(SceneRenderItemRecord) % 16 == 0);
+
+class SceneFile
+{
+public:
+    // Maps the file and validates the header and section bounds. Files with
+    // another content version are rejected, so a scene baked by older code
+    // is built again.
+    bool Open(const std::wstring& fileName, uint32_t contentVersion);
+    void Close();
+
+    std::span<const SceneMaterialRecord> Materials() const;
+    std::span<const SceneGeometryRef> GeometryRefs() const;
+    std::span<const SceneRenderItemRecord> RenderItems() const;
+
+    static bool Write(const std::wstring& fileName, uint32_t contentVersion,
+        std::span<const SceneMaterialRecord> materials,
+        std::span<const SceneGeometryRef> geometryRefs,
+        std::span<const SceneRenderItemRecord> renderItems);
+
+    // Copies a name into a fixed size record field, truncating if needed.
+    template<size_t N>
+    static void SetName(char (&dest)[N], const std::string& name)
+    {
+        size_t count = name.size() < N - 1 ? name.size() : N - 1;
+        name.copy(dest, count);
+        dest[count] = '\0';
+    }
+
+private:
+    MappedFile mFile;
+    const SceneFileHeader* mHeader = nullptr;
+};
@@ -0,0 +1,98 @@
+#include "ShaderCache.h"
+#include "FileUtil.h"
+#include <cstdio>
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    struct ShaderCacheHeader
+    {
+        static constexpr uint32_t MagicValue = 0x4353584C; // "LXSC"
+
+        uint32_t Magic = MagicValue;
+        uint32_t Version = ShaderCache::Version;
+        uint64_t KeyHash = 0;
+        uint64_t KeyCheck = 0;
+        uint64_t BytecodeSize = 0;
+        uint64_t BytecodeHash = 0;
+    };
+
+    static_assert(sizeof(ShaderCacheHeader) == 40);
+
+    constexpr uint64_t KeySeed = FileUtil::HashBasis;
+    // Any other basis gives a hash independent enough to catch collisions.
+    constexpr uint64_t CheckSeed = 0x9E3779B97F4A7C15ull;
+
+    // Strings are hashed with their length, so fields can't run into each other.
+    uint64_t Hash(std::string_view text, uint64_t hash)
+    {
+        const uint64_t size = text.size();
+        hash = FileUtil::Hash(&size, sizeof(size), hash);
+        return FileUtil::Hash(text.data(), text.size(), hash);
+    }
+}
+
+uint64_t ShaderCache::Hash(const ShaderCacheKey& key, uint64_t seed)
+{
+    uint64_t hash = ::Hash(key.Source, seed);
+    hash = ::Hash(key.Defines, hash);
+    hash = ::Hash(key.EntryPoint, hash);
+    hash = ::Hash(key.Target, hash);
+    const uint32_t numbers[] = { key.Flags, key.CompilerVersion, Version };
+    return FileUtil::Hash(numbers, sizeof(numbers), hash);
+}
+
+std::wstring ShaderCache::EntryPath(const std::wstring& directory, const ShaderCacheKey& key)
+{
+    wchar_t name[32];
+    swprintf(name, sizeof(name) / sizeof(name[0]), L"%016llx.cso", (unsigned long long)Hash(key, KeySeed));
+    return (std::filesystem::path(directory) / name).wstring();
+}
+
+bool ShaderCache::Load(const std::wstring& fileName, const ShaderCacheKey& key, std::vector<uint8_t>& bytecode)
+{
+    std::ifstream file(std::filesystem::path(fileName), std::ios::binary);
+    if (!file)
+        return false;
+
+    ShaderCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    if (header.Magic != ShaderCacheHeader::MagicValue || header.Version != Version ||
+        header.KeyHash != Hash(key, KeySeed) || header.KeyCheck != Hash(key, CheckSeed))
+        return false;
+
+    // The size is checked against the file before allocating for it.
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(std::filesystem::path(fileName), error);
+    if (error || fileSize != sizeof(header) + header.BytecodeSize)
+        return false;
+
+    bytecode.resize((size_t)header.BytecodeSize);
+    if (!file.read(reinterpret_cast<char*>(bytecode.data()), (std::streamsize)bytecode.size()) ||
+        FileUtil::Hash(bytecode.data(), bytecode.size(), KeySeed) != header.BytecodeHash)
+    {
+        bytecode.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ShaderCache::Store(const std::wstring& fileName, const ShaderCacheKey& key, std::span<const uint8_t> bytecode)
+{
+    ShaderCacheHeader header;
+    header.KeyHash = Hash(key, KeySeed);
+    header.KeyCheck = Hash(key, CheckSeed);
+    header.BytecodeSize = bytecode.size();
+    header.BytecodeHash = FileUtil::Hash(bytecode.data(), bytecode.size(), KeySeed);
+
+    // Readers never see a partial entry.
+    return FileUtil::WriteAtomically(fileName, [&](std::ofstream& file)
+    {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(bytecode.data()), (std::streamsize)bytecode.size());
+    });
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Everything compiled bytecode depends on. Source is the preprocessed
+// source, so edits to included files change the key as well.
+struct ShaderCacheKey
+{
+    std::string_view Source;
+    std::string_view Defines;       // "NAME=VALUE\n" per macro
+    std::string_view EntryPoint;
+    std::string_view Target;
+    uint32_t Flags = 0;
+    uint32_t CompilerVersion = 0;
+};
+
+// On-disk cache for compiled shaders. Entries are named by a hash of their
+// key and carry a second, independently seeded hash of it plus a hash of the
+// bytecode, so a colliding, stale or truncated entry is rejected on load and
+// the shader is simply compiled again.
+//
+// Doesn't depend on the D3D headers, so it builds anywhere.
+class ShaderCache
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    static uint64_t Hash(const ShaderCacheKey& key, uint64_t seed);
+
+    static std::wstring EntryPath(const std::wstring& directory, const ShaderCacheKey& key);
+
+    // Bytecode cached for key in fileName. Returns false if there is no
+    // valid entry for exactly this key.
+    static bool Load(const std::wstring& fileName, const ShaderCacheKey& key, std::vector<uint8_t>& bytecode);
+
+    // Returns false if the entry could not be written; the shader is then
+    // compiled again on the next run.
+    static bool Store(const std::wstring& fileName, const ShaderCacheKey& key, std::span<const uint8_t> bytecode);
+};
@@ -0,0 +1,48 @@
+#include "ShaderPermutations.h"
+#include "GraphicsUtil.h"
+
+ShaderPermutations::ShaderPermutations(std::wstring fileName, std::string entryPoint, std::string target,
+    std::vector<std::string> features)
+    : mFileName(std::move(fileName)), mEntryPoint(std::move(entryPoint)), mTarget(std::move(target)),
+    mFeatures(std::move(features)),
+    mPermutations((uint32_t)mFeatures.size(), [this](uint32_t key) { return Compile(key); })
+{
+}
+
+uint32_t ShaderPermutations::Bit(std::string_view feature) const
+{
+    for (size_t i = 0; i < mFeatures.size(); ++i)
+    {
+        if (mFeatures[i] == feature)
+            return 1u << i;
+    }
+    return 0;
+}
+
+uint32_t ShaderPermutations::Count() const
+{
+    return mPermutations.Count();
+}
+
+void ShaderPermutations::Prefetch(uint32_t key)
+{
+    mPermutations.Prefetch(key);
+}
+
+ID3DBlob* ShaderPermutations::Get(uint32_t key)
+{
+    return mPermutations.Get(key).Get();
+}
+
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderPermutations::Compile(uint32_t key) const
+{
+    std::vector<D3D_SHADER_MACRO> defines;
+    for (size_t i = 0; i < mFeatures.size(); ++i)
+    {
+        if (key & (1u << i))
+            defines.push_back({ mFeatures[i].c_str(), "1" });
+    }
+    defines.push_back({ nullptr, nullptr });
+
+    return GraphicsUtil::CompileShader(mFileName, defines.data(), mEntryPoint, mTarget);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <d3dcommon.h>
+#include <wrl.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "PermutationTable.h"
+
+// The permutations of one shader entry point. The shader declares its
+// features as macro names; bit i of a key defines features[i] as 1 and leaves
+// it undefined otherwise, so the shader tests it with #ifdef. Permutations
+// are compiled through GraphicsUtil::CompileShader, and so its cache, the
+// first time they are used.
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(std::wstring fileName, std::string entryPoint, std::string target,
+        std::vector<std::string> features = {});
+
+    ShaderPermutations(const ShaderPermutations& rhs) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations& rhs) = delete;
+
+    // Key bit of a declared feature, 0 for one the shader doesn't have.
+    uint32_t Bit(std::string_view feature) const;
+    // Keys below this are valid.
+    uint32_t Count() const;
+
+    void Prefetch(uint32_t key);
+    // Waits for the permutation; null if it failed to compile.
+    ID3DBlob* Get(uint32_t key);
+
+private:
+    Microsoft::WRL::ComPtr<ID3DBlob> Compile(uint32_t key) const;
+
+    const std::wstring mFileName;
+    const std::string mEntryPoint;
+    const std::string mTarget;
+    const std::vector<std::string> mFeatures;
+    PermutationTable<Microsoft::WRL::ComPtr<ID3DBlob>> mPermutations;
+};
@@ -0,0 +1,179 @@
+#include "SpecularPrefilter.h"
+#include "EnvironmentMap.h"
+#include "MipGenerator.h"
+#include "ParallelFor.h"
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    // Texels per thread below which work runs on fewer threads.
+    constexpr UINT MinTexelsPerThread = 256;
+
+    // A light direction in the tangent frame of the texel, where the normal
+    // and view direction are +z.
+    struct LightSample
+    {
+        XMFLOAT3 Direction;
+        float Weight;
+        float SourceLevel;
+    };
+
+    float RadicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    float DistributionGGX(float NdotH, float alpha)
+    {
+        const float a2 = alpha * alpha;
+        const float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+        return a2 / (XM_PI * d * d);
+    }
+
+    std::vector<LightSample> BuildSamples(float roughness, UINT sampleCount, UINT sourceSize)
+    {
+        const float alpha = roughness * roughness;
+        const float texelSolidAngle = 4.0f * XM_PI / (6.0f * sourceSize * sourceSize);
+
+        std::vector<LightSample> samples;
+        samples.reserve(sampleCount);
+        for (UINT i = 0; i < sampleCount; ++i)
+        {
+            // GGX distributed half vector, reflected about the normal.
+            const float phi = 2.0f * XM_PI * (i + 0.5f) / sampleCount;
+            const float u = RadicalInverse(i);
+            const float cosTheta = std::sqrt((1.0f - u) / (1.0f + (alpha * alpha - 1.0f) * u));
+            const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+            const XMFLOAT3 h(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+
+            const XMFLOAT3 l(2.0f * cosTheta * h.x, 2.0f * cosTheta * h.y, 2.0f * cosTheta * cosTheta - 1.0f);
+            if (l.z <= 0.0f)
+                continue;
+
+            // With the view along the normal the PDF of l is D / 4.
+            const float pdf = DistributionGGX(cosTheta, alpha) * 0.25f;
+            const float sampleSolidAngle = 1.0f / (sampleCount * pdf + 1e-6f);
+            const float level = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+            samples.push_back({ l, l.z, level });
+        }
+        return samples;
+    }
+
+    // Tangent frame with the normal as z.
+    void Frame(FXMVECTOR n, XMVECTOR& tangent, XMVECTOR& bitangent)
+    {
+        const XMVECTOR up = std::fabs(XMVectorGetZ(n)) < 0.999f ? g_XMIdentityR2 : g_XMIdentityR0;
+        tangent = XMVector3Normalize(XMVector3Cross(up, n));
+        bitangent = XMVector3Cross(n, tangent);
+    }
+}
+
+float SpecularPrefilter::LevelRoughness(UINT level, UINT mipLevels)
+{
+    return mipLevels > 1 ? (float)level / (mipLevels - 1) : 0.0f;
+}
+
+void SpecularPrefilter::Prefilter(const EnvironmentMap& source, UINT size, UINT sampleCount,
+    std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+    const UINT mipLevels = MipGenerator::FullMipCount(size, size);
+
+    // Offsets of every face and level in data, in D3D12 order.
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    for (UINT face = 0; face < 6; ++face)
+    {
+        for (UINT level = 0; level < mipLevels; ++level)
+        {
+            const UINT levelSize = std::max(size >> level, 1u);
+            offsets.push_back(total);
+            total += (size_t)levelSize * levelSize * sizeof(XMHALF4);
+        }
+    }
+    data = std::make_unique<uint8_t[]>(total);
+    subresources.clear();
+    for (UINT face = 0; face < 6; ++face)
+    {
+        for (UINT level = 0; level < mipLevels; ++level)
+        {
+            const UINT levelSize = std::max(size >> level, 1u);
+            D3D12_SUBRESOURCE_DATA subresource;
+            subresource.pData = data.get() + offsets[(size_t)face * mipLevels + level];
+            subresource.RowPitch = (LONG_PTR)levelSize * sizeof(XMHALF4);
+            subresource.SlicePitch = subresource.RowPitch * levelSize;
+            subresources.push_back(subresource);
+        }
+    }
+
+    auto texel = [&](UINT face, UINT level, size_t index)
+    {
+        return reinterpret_cast<XMHALF4*>(data.get() + offsets[(size_t)face * mipLevels + level]) + index;
+    };
+
+    // Level 0 is a plain resample, one lookup per texel.
+    ParallelFor(size * size * 6, MinTexelsPerThread, [&](UINT begin, UINT end)
+    {
+        for (UINT i = begin; i < end; ++i)
+        {
+            const UINT face = i / (size * size);
+            const UINT x = i % size;
+            const UINT y = (i / size) % size;
+            XMStoreHalf4(texel(face, 0, (size_t)size * y + x),
+                source.Sample(EnvironmentMap::TexelDirection(face, x, y, size), 0.0f));
+        }
+    });
+
+    // The other levels cost the same per texel; their texels are numbered
+    // level by level, face by face.
+    std::vector<std::vector<LightSample>> samples(mipLevels);
+    std::vector<UINT> firstTexel(mipLevels + 1, 0);
+    for (UINT level = 1; level < mipLevels; ++level)
+    {
+        const UINT levelSize = std::max(size >> level, 1u);
+        samples[level] = BuildSamples(LevelRoughness(level, mipLevels), sampleCount, source.Size(0));
+        firstTexel[level + 1] = firstTexel[level] + levelSize * levelSize * 6;
+    }
+
+    ParallelFor(firstTexel[mipLevels], MinTexelsPerThread, [&](UINT begin, UINT end)
+    {
+        UINT level = 1;
+        for (UINT i = begin; i < end; ++i)
+        {
+            while (i >= firstTexel[level + 1])
+                ++level;
+            const UINT levelSize = std::max(size >> level, 1u);
+            const UINT index = i - firstTexel[level];
+            const UINT face = index / (levelSize * levelSize);
+            const UINT x = index % levelSize;
+            const UINT y = (index / levelSize) % levelSize;
+
+            const XMVECTOR n = XMVector3Normalize(EnvironmentMap::TexelDirection(face, x, y, levelSize));
+            XMVECTOR t, b;
+            Frame(n, t, b);
+
+            XMVECTOR sum = XMVectorZero();
+            float weightSum = 0.0f;
+            for (const LightSample& sample : samples[level])
+            {
+                XMVECTOR l = XMVectorScale(t, sample.Direction.x);
+                l = XMVectorMultiplyAdd(b, XMVectorReplicate(sample.Direction.y), l);
+                l = XMVectorMultiplyAdd(n, XMVectorReplicate(sample.Direction.z), l);
+                sum = XMVectorMultiplyAdd(source.Sample(l, sample.SourceLevel), XMVectorReplicate(sample.Weight), sum);
+                weightSum += sample.Weight;
+            }
+            XMStoreHalf4(texel(face, level, (size_t)levelSize * y + x),
+                weightSum > 0.0f ? XMVectorScale(sum, 1.0f / weightSum) : sum);
+        }
+    });
+}
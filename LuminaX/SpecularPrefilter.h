@@ -0,0 +1,36 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class EnvironmentMap;
+
+// Bakes the roughness-prefiltered specular cube map of the split-sum
+// approximation: level m holds the environment convolved with the GGX lobe of
+// perceptual roughness m / (levels - 1), with the view direction taken to be
+// the normal. Level 0 is the environment itself.
+//
+// Light directions are importance sampled from a Hammersley set. With the
+// normal and view direction equal, the samples in tangent space, their cosine
+// weights and source levels are the same for every texel, so they are
+// computed once per level and each texel only rotates them into its frame.
+// The source level of a sample follows from its PDF: the solid angle the
+// sample stands for is matched with the solid angle of a source texel, which
+// keeps few samples from aliasing on a detailed environment. Texels of all
+// faces and levels are split across threads in equal shares.
+class SpecularPrefilter
+{
+public:
+    // Bumped whenever the output changes, so baked files are made again.
+    static constexpr uint32_t Version = 1;
+    static constexpr DXGI_FORMAT Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+    static float LevelRoughness(UINT level, UINT mipLevels);
+
+    // Prefilters source into a cube map of size texels square with a full
+    // chain. data receives all faces and levels tightly packed, and
+    // subresources point into it in D3D12 order, face major.
+    static void Prefilter(const EnvironmentMap& source, UINT size, UINT sampleCount,
+        std::unique_ptr<uint8_t[]>& data, std::vector<D3D12_SUBRESOURCE_DATA>& subresources);
+};
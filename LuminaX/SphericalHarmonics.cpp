@@ -0,0 +1,105 @@
+#include "SphericalHarmonics.h"
+#include "EnvironmentMap.h"
+#include "ParallelFor.h"
+#include <mutex>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // Squared basis constant times the cosine lobe's band factor over pi
+    // (1, 2/3 and 1/4 for the three bands), per coefficient.
+    constexpr float Scale[SphericalHarmonics::CoefficientCount] =
+    {
+        1.0f / (4.0f * XM_PI),
+        1.0f / (2.0f * XM_PI), 1.0f / (2.0f * XM_PI), 1.0f / (2.0f * XM_PI),
+        15.0f / (16.0f * XM_PI), 15.0f / (16.0f * XM_PI),
+        5.0f / (64.0f * XM_PI),
+        15.0f / (16.0f * XM_PI),
+        15.0f / (64.0f * XM_PI),
+    };
+
+    constexpr uint32_t MinRowsPerThread = 16;
+
+    void Basis(FXMVECTOR n, float basis[SphericalHarmonics::CoefficientCount])
+    {
+        const float x = XMVectorGetX(n);
+        const float y = XMVectorGetY(n);
+        const float z = XMVectorGetZ(n);
+        basis[0] = 1.0f;
+        basis[1] = y;
+        basis[2] = z;
+        basis[3] = x;
+        basis[4] = x * y;
+        basis[5] = y * z;
+        basis[6] = 3.0f * z * z - 1.0f;
+        basis[7] = x * z;
+        basis[8] = x * x - y * y;
+    }
+}
+
+void SphericalHarmonics::ProjectIrradiance(const EnvironmentMap& map, uint32_t level,
+    XMFLOAT4 coefficients[CoefficientCount])
+{
+    const uint32_t size = map.Size(level);
+
+    // Every face has the same solid angles.
+    std::vector<float> solidAngles((size_t)size * size);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+            solidAngles[(size_t)size * y + x] = EnvironmentMap::TexelSolidAngle(x, y, size);
+    }
+
+    XMVECTOR sums[CoefficientCount] = {};
+    float weightSum = 0.0f;
+    std::mutex mutex;
+    ParallelFor(size * 6, MinRowsPerThread, [&](uint32_t begin, uint32_t end)
+    {
+        XMVECTOR partial[CoefficientCount] = {};
+        float partialWeight = 0.0f;
+        for (uint32_t faceRow = begin; faceRow < end; ++faceRow)
+        {
+            const uint32_t face = faceRow / size;
+            const uint32_t y = faceRow % size;
+            const XMFLOAT4A* row = map.Face(level, face) + (size_t)size * y;
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                const float weight = solidAngles[(size_t)size * y + x];
+                const XMVECTOR color = XMVectorScale(XMLoadFloat4A(&row[x]), weight);
+
+                float basis[CoefficientCount];
+                Basis(XMVector3Normalize(EnvironmentMap::TexelDirection(face, x, y, size)), basis);
+                for (int i = 0; i < CoefficientCount; ++i)
+                    partial[i] = XMVectorMultiplyAdd(color, XMVectorReplicate(basis[i]), partial[i]);
+                partialWeight += weight;
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        for (int i = 0; i < CoefficientCount; ++i)
+            sums[i] = XMVectorAdd(sums[i], partial[i]);
+        weightSum += partialWeight;
+    });
+
+    // The solid angles add up to 4 pi up to rounding; normalizing to it keeps
+    // a constant environment exactly constant.
+    const float normalization = 4.0f * XM_PI / weightSum;
+    for (int i = 0; i < CoefficientCount; ++i)
+    {
+        XMVECTOR c = XMVectorScale(sums[i], Scale[i] * normalization);
+        XMStoreFloat4(&coefficients[i], XMVectorSetW(c, 0.0f));
+    }
+}
+
+XMVECTOR SphericalHarmonics::EvaluateIrradiance(const XMFLOAT4 coefficients[CoefficientCount], FXMVECTOR normal)
+{
+    float basis[CoefficientCount];
+    Basis(normal, basis);
+
+    XMVECTOR result = XMVectorZero();
+    for (int i = 0; i < CoefficientCount; ++i)
+        result = XMVectorMultiplyAdd(XMLoadFloat4(&coefficients[i]), XMVectorReplicate(basis[i]), result);
+    return XMVectorMax(result, XMVectorZero());
+}
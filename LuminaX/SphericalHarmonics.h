@@ -0,0 +1,34 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+
+class EnvironmentMap;
+
+// Diffuse environment lighting as order 2 spherical harmonics: 9 RGB
+// coefficients instead of an irradiance cube map.
+//
+// The coefficients are convolved with the clamped cosine lobe, divided by pi
+// and premultiplied with the basis constants, so the diffuse light of a
+// surface is the basis polynomial of its normal dotted with them:
+//
+//     c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+//
+// which is what IrradianceSH in common.hlsl evaluates. The w of every
+// coefficient is unused so they can sit in a constant buffer as float4s.
+class SphericalHarmonics
+{
+public:
+    // Bumped whenever the projection gives other coefficients.
+    static constexpr uint32_t Version = 1;
+    static constexpr int CoefficientCount = 9;
+
+    // Projects every texel of a level of the map, weighted by its solid
+    // angle. Face rows are split across threads, each texel's color is
+    // accumulated into the nine sums with one SIMD multiply-add each.
+    static void ProjectIrradiance(const EnvironmentMap& map, uint32_t level,
+        DirectX::XMFLOAT4 coefficients[CoefficientCount]);
+
+    // The diffuse light the coefficients give for normal, as the shader does.
+    static DirectX::XMVECTOR EvaluateIrradiance(const DirectX::XMFLOAT4 coefficients[CoefficientCount],
+        DirectX::FXMVECTOR normal);
+};
@@ -0,0 +1,130 @@
+#include "TextureCache.h"
+#include "FileUtil.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+    constexpr uint32_t DdsMagic = 0x20534444;   // "DDS "
+
+    constexpr uint32_t DdsdCaps = 0x1;
+    constexpr uint32_t DdsdHeight = 0x2;
+    constexpr uint32_t DdsdWidth = 0x4;
+    constexpr uint32_t DdsdPixelFormat = 0x1000;
+    constexpr uint32_t DdsdMipMapCount = 0x20000;
+    constexpr uint32_t DdsdLinearSize = 0x80000;
+    constexpr uint32_t DdpfFourCC = 0x4;
+    constexpr uint32_t DdsCapsComplex = 0x8;
+    constexpr uint32_t DdsCapsTexture = 0x1000;
+    constexpr uint32_t DdsCapsMipMap = 0x400000;
+    constexpr uint32_t DdsCaps2CubeMapAllFaces = 0xFE00;
+    constexpr uint32_t ResourceMiscTextureCube = 0x4;
+    constexpr uint32_t FourCCDX10 = 0x30315844;  // "DX10"
+
+    struct DdsPixelFormat
+    {
+        uint32_t Size;
+        uint32_t Flags;
+        uint32_t FourCC;
+        uint32_t RGBBitCount;
+        uint32_t RBitMask;
+        uint32_t GBitMask;
+        uint32_t BBitMask;
+        uint32_t ABitMask;
+    };
+
+    struct DdsHeader
+    {
+        uint32_t Size;
+        uint32_t Flags;
+        uint32_t Height;
+        uint32_t Width;
+        uint32_t PitchOrLinearSize;
+        uint32_t Depth;
+        uint32_t MipMapCount;
+        uint32_t Reserved1[11];
+        DdsPixelFormat PixelFormat;
+        uint32_t Caps;
+        uint32_t Caps2;
+        uint32_t Caps3;
+        uint32_t Caps4;
+        uint32_t Reserved2;
+    };
+
+    struct DdsHeaderDX10
+    {
+        uint32_t DxgiFormat;
+        uint32_t ResourceDimension;
+        uint32_t MiscFlag;
+        uint32_t ArraySize;
+        uint32_t MiscFlags2;
+    };
+
+    static_assert(sizeof(DdsHeader) == 124);
+    static_assert(sizeof(DdsHeaderDX10) == 20);
+}
+
+std::wstring TextureCache::EntryPath(const std::wstring& directory, const std::wstring& sourceFile, uint64_t settings)
+{
+    MappedFile source;
+    if (!source.Open(sourceFile))
+        return std::wstring();
+
+    return EntryPath(directory, sourceFile, { source.Data(), (size_t)source.Size() }, settings);
+}
+
+std::wstring TextureCache::EntryPath(const std::wstring& directory, const std::wstring& sourceFile,
+    std::span<const uint8_t> contents, uint64_t settings)
+{
+    uint64_t hash = FileUtil::Hash(contents.data(), contents.size());
+    hash = FileUtil::Hash(&settings, sizeof(settings), hash);
+
+    wchar_t key[17];
+    swprintf_s(key, L"%016llx", (unsigned long long)hash);
+
+    // The source name is only there to make the directory readable.
+    std::filesystem::path path = std::filesystem::path(directory) /
+        (std::filesystem::path(sourceFile).stem().wstring() + L"_" + key + L".dds");
+    return path.wstring();
+}
+
+bool TextureCache::Write(const std::wstring& fileName, DXGI_FORMAT format, UINT width, UINT height,
+    const std::vector<D3D12_SUBRESOURCE_DATA>& levels, bool cubeMap)
+{
+    const size_t mipCount = cubeMap ? levels.size() / 6 : levels.size();
+
+    DdsHeader header = {};
+    header.Size = sizeof(DdsHeader);
+    header.Flags = DdsdCaps | DdsdHeight | DdsdWidth | DdsdPixelFormat | DdsdMipMapCount | DdsdLinearSize;
+    header.Height = height;
+    header.Width = width;
+    header.PitchOrLinearSize = levels.empty() ? 0 : (uint32_t)levels[0].SlicePitch;
+    header.MipMapCount = (uint32_t)mipCount;
+    header.PixelFormat.Size = sizeof(DdsPixelFormat);
+    header.PixelFormat.Flags = DdpfFourCC;
+    header.PixelFormat.FourCC = FourCCDX10;
+    header.Caps = DdsCapsTexture | (mipCount > 1 ? DdsCapsMipMap | DdsCapsComplex : 0);
+    if (cubeMap)
+    {
+        header.Caps |= DdsCapsComplex;
+        header.Caps2 = DdsCaps2CubeMapAllFaces;
+    }
+
+    DdsHeaderDX10 headerDX10 = {};
+    headerDX10.DxgiFormat = (uint32_t)format;
+    headerDX10.ResourceDimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    headerDX10.MiscFlag = cubeMap ? ResourceMiscTextureCube : 0;
+    headerDX10.ArraySize = 1;
+
+    // Workers importing the same file may race on the entry; each writes
+    // its own temporary file.
+    return FileUtil::WriteAtomically(fileName, [&](std::ofstream& file)
+    {
+        file.write(reinterpret_cast<const char*>(&DdsMagic), sizeof(DdsMagic));
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&headerDX10), sizeof(headerDX10));
+        for (const auto& level : levels)
+            file.write(static_cast<const char*>(level.pData), level.SlicePitch);
+    });
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "directx/d3d12.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// On-disk cache for imported textures. Entries are DDS files, so they load
+// through the regular DDS path; their names carry a hash of the source
+// file's contents and of the import settings, so editing either one simply
+// misses the cache.
+class TextureCache
+{
+public:
+    // Cache file for sourceFile imported with settings, or an empty string
+    // if the source can't be read.
+    static std::wstring EntryPath(const std::wstring& directory, const std::wstring& sourceFile, uint64_t settings);
+    // Same for a source whose contents are already in memory.
+    static std::wstring EntryPath(const std::wstring& directory, const std::wstring& sourceFile,
+        std::span<const uint8_t> contents, uint64_t settings);
+
+    // Writes a 2D texture with a full set of levels as a DDS file with a
+    // DX10 header. Returns false if the file could not be written; a cache
+    // that can't be written to only costs the next load its time.
+    //
+    // A cube map has six faces' worth of levels, face major as D3D12 orders
+    // its subresources.
+    static bool Write(const std::wstring& fileName, DXGI_FORMAT format, UINT width, UINT height,
+        const std::vector<D3D12_SUBRESOURCE_DATA>& levels, bool cubeMap = false);
+};
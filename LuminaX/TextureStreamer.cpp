@@ -0,0 +1,272 @@
+#include "TextureStreamer.h"
+#include "GraphicsUtil.h"
+#include "UploadManager.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    UINT TileCount(const D3D12_SUBRESOURCE_TILING& tiling)
+    {
+        return tiling.WidthInTiles * (UINT)tiling.HeightInTiles * (UINT)tiling.DepthInTiles;
+    }
+
+    // Maps tileCount tiles starting at mip to the start of heap, or unmaps
+    // them when heap is null.
+    void UpdateMapping(ID3D12CommandQueue* queue, ID3D12Resource* resource, UINT mip, UINT tileCount, ID3D12Heap* heap)
+    {
+        D3D12_TILED_RESOURCE_COORDINATE start = {};
+        start.Subresource = mip;
+        D3D12_TILE_REGION_SIZE size = {};
+        size.NumTiles = tileCount;
+
+        const D3D12_TILE_RANGE_FLAGS flags = heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL;
+        const UINT heapOffset = 0;
+        queue->UpdateTileMappings(resource, 1, &start, &size, heap, 1, &flags,
+            heap ? &heapOffset : nullptr, &tileCount, D3D12_TILE_MAPPING_FLAG_NONE);
+    }
+}
+
+bool TextureStreamer::IsSupported(ID3D12Device* device)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+    if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))))
+        return false;
+    return options.TiledResourcesTier >= D3D12_TILED_RESOURCES_TIER_1;
+}
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, ID3D12CommandQueue* directQueue, UploadManager* uploader,
+    UINT64 budgetBytes, UINT64 uploadBytesPerUpdate)
+    : md3dDevice(device), mDirectQueue(directQueue), mUploader(uploader),
+      mBudgetBytes(budgetBytes), mUploadBytesPerUpdate(uploadBytesPerUpdate)
+{
+}
+
+TextureStreamer::~TextureStreamer() = default;
+
+uint32_t TextureStreamer::Add(DecodedTexture&& decoded)
+{
+    StreamedTexture texture;
+    texture.Source = std::make_unique<DecodedTexture>(std::move(decoded));
+
+    // The loaders create a committed resource. Nothing was uploaded to it
+    // yet, so it is replaced by a reserved one with the same description.
+    D3D12_RESOURCE_DESC desc = texture.Source->Resource->GetDesc();
+    texture.Source->Resource.Reset();
+    desc.Alignment = 0;
+    desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+    ThrowIfFailed(md3dDevice->CreateReservedResource(&desc, D3D12_RESOURCE_STATE_COMMON, nullptr,
+        IID_PPV_ARGS(&texture.Resource)));
+
+    texture.Size = (UINT)std::max<UINT64>(desc.Width, desc.Height);
+    texture.MipLevels = desc.MipLevels;
+
+    UINT tileCount = 0;
+    D3D12_PACKED_MIP_INFO packedMips = {};
+    D3D12_TILE_SHAPE tileShape = {};
+    UINT subresourceCount = texture.MipLevels;
+    std::vector<D3D12_SUBRESOURCE_TILING> tilings(subresourceCount);
+    md3dDevice->GetResourceTiling(texture.Resource.Get(), &tileCount, &packedMips, &tileShape,
+        &subresourceCount, 0, tilings.data());
+
+    // Without a packed tail the coarsest level is kept resident instead.
+    UINT pinnedTiles = 0;
+    if (packedMips.NumPackedMips > 0)
+    {
+        texture.PinnedMip = packedMips.NumStandardMips;
+        pinnedTiles = packedMips.NumTilesForPackedMips;
+    }
+    else
+    {
+        texture.PinnedMip = texture.MipLevels - 1;
+        pinnedTiles = TileCount(tilings[texture.PinnedMip]);
+    }
+
+    texture.MipHeaps.resize(texture.PinnedMip);
+    texture.MipBytes.resize(texture.PinnedMip);
+    for (UINT mip = 0; mip < texture.PinnedMip; ++mip)
+        texture.MipBytes[mip] = (UINT64)TileCount(tilings[mip]) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+
+    texture.PinnedHeap = CreateTileHeap(pinnedTiles);
+    texture.PinnedBytes = (UINT64)pinnedTiles * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+    UpdateMapping(mUploader->Queue(), texture.Resource.Get(), texture.PinnedMip, pinnedTiles, texture.PinnedHeap.Get());
+    mUploader->UploadToTexture(texture.Resource.Get(), texture.PinnedMip,
+        { texture.Source->Subresources.data() + texture.PinnedMip, texture.MipLevels - texture.PinnedMip });
+
+    texture.LoadingMip = texture.PinnedMip;
+    texture.LoadFence = mUploader->Submit();
+    texture.WantedMip = texture.PinnedMip;
+    texture.LastUsedFrame = mFrame;
+    mResidentBytes += texture.PinnedBytes;
+
+    mTextures.push_back(std::move(texture));
+    return (uint32_t)mTextures.size() - 1;
+}
+
+float TextureStreamer::RequiredMip(uint32_t id, float worldUnitsPerUV, float pixelsPerWorldUnit) const
+{
+    const float texelsPerWorldUnit = mTextures[id].Size / std::max(worldUnitsPerUV, 1e-6f);
+    return std::log2(std::max(texelsPerWorldUnit / std::max(pixelsPerWorldUnit, 1e-6f), 1.0f));
+}
+
+void TextureStreamer::Request(uint32_t id, float mip)
+{
+    // Trilinear filtering blends with the next finer level, so round down.
+    auto& texture = mTextures[id];
+    const UINT level = std::min((UINT)std::max(std::floor(mip), 0.0f), texture.PinnedMip);
+    texture.WantedMip = std::min(texture.WantedMip, level);
+    texture.LastUsedFrame = mFrame;
+}
+
+void TextureStreamer::Update(UINT64 nextFrameFence, UINT64 completedFrameFence, std::vector<uint32_t>& changed)
+{
+    while (!mPendingReleases.empty() && mPendingReleases.front().Fence <= completedFrameFence)
+        mPendingReleases.pop_front();
+
+    for (uint32_t id = 0; id < (uint32_t)mTextures.size(); ++id)
+    {
+        auto& texture = mTextures[id];
+        if (texture.LoadingMip != NoMip && mUploader->IsComplete(texture.LoadFence) &&
+            CanChangeClamp(texture, completedFrameFence))
+        {
+            Publish(id, texture.LoadingMip, nextFrameFence, changed);
+            texture.LoadingMip = NoMip;
+        }
+    }
+
+    // One level per texture and update, coarsest first, starting with the
+    // textures that are furthest from what they need.
+    std::vector<uint32_t> candidates;
+    for (uint32_t id = 0; id < (uint32_t)mTextures.size(); ++id)
+    {
+        const auto& texture = mTextures[id];
+        if (texture.ResidentMip != NoMip && texture.LoadingMip == NoMip && texture.WantedMip < texture.ResidentMip)
+            candidates.push_back(id);
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b)
+    {
+        return mTextures[a].ResidentMip - mTextures[a].WantedMip > mTextures[b].ResidentMip - mTextures[b].WantedMip;
+    });
+
+    std::vector<uint32_t> loading;
+    UINT64 uploadBytes = 0;
+    for (uint32_t id : candidates)
+    {
+        auto& texture = mTextures[id];
+        const UINT mip = texture.ResidentMip - 1;
+        const UINT64 bytes = texture.MipBytes[mip];
+        if (!loading.empty() && uploadBytes + bytes > mUploadBytesPerUpdate)
+            break;
+        if (!MakeRoom(bytes, id, nextFrameFence, completedFrameFence, changed))
+            continue;
+
+        // The mapping is queued on the copy queue ahead of the copy.
+        const UINT tileCount = (UINT)(bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+        texture.MipHeaps[mip] = CreateTileHeap(tileCount);
+        UpdateMapping(mUploader->Queue(), texture.Resource.Get(), mip, tileCount, texture.MipHeaps[mip].Get());
+        mUploader->UploadToTexture(texture.Resource.Get(), mip, { &texture.Source->Subresources[mip], 1 });
+
+        texture.LoadingMip = mip;
+        mResidentBytes += bytes;
+        uploadBytes += bytes;
+        loading.push_back(id);
+    }
+
+    if (!loading.empty())
+    {
+        const UINT64 fence = mUploader->Submit();
+        for (uint32_t id : loading)
+            mTextures[id].LoadFence = fence;
+    }
+
+    // Requests only hold for the frame they were made in.
+    for (auto& texture : mTextures)
+        texture.WantedMip = texture.PinnedMip;
+    mFrame++;
+}
+
+ID3D12Resource* TextureStreamer::Resource(uint32_t id) const
+{
+    return mTextures[id].Resource.Get();
+}
+
+UINT TextureStreamer::ResidentMip(uint32_t id) const
+{
+    return mTextures[id].ResidentMip;
+}
+
+UINT TextureStreamer::SrvSlot(uint32_t id) const
+{
+    return mTextures[id].SrvSlot;
+}
+
+TextureStreamer::Stats TextureStreamer::GetStats() const
+{
+    Stats stats;
+    stats.BudgetBytes = mBudgetBytes;
+    stats.ResidentBytes = mResidentBytes;
+    stats.TextureCount = (UINT)mTextures.size();
+    for (const auto& texture : mTextures)
+    {
+        if (texture.LoadingMip != NoMip)
+            stats.LoadingCount++;
+    }
+    return stats;
+}
+
+Microsoft::WRL::ComPtr<ID3D12Heap> TextureStreamer::CreateTileHeap(UINT64 tileCount)
+{
+    CD3DX12_HEAP_DESC desc(tileCount * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES, D3D12_HEAP_TYPE_DEFAULT, 0,
+        D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES);
+
+    Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+    ThrowIfFailed(md3dDevice->CreateHeap(&desc, IID_PPV_ARGS(&heap)));
+    return heap;
+}
+
+bool TextureStreamer::CanChangeClamp(const StreamedTexture& texture, UINT64 completedFrameFence) const
+{
+    // The other descriptor is free once the frames that used it are done.
+    return completedFrameFence >= texture.ClampFence;
+}
+
+void TextureStreamer::Publish(uint32_t id, UINT mip, UINT64 nextFrameFence, std::vector<uint32_t>& changed)
+{
+    auto& texture = mTextures[id];
+    texture.ResidentMip = mip;
+    texture.SrvSlot ^= 1;
+    texture.ClampFence = nextFrameFence;
+    changed.push_back(id);
+}
+
+bool TextureStreamer::MakeRoom(UINT64 bytes, uint32_t requester, UINT64 nextFrameFence, UINT64 completedFrameFence,
+    std::vector<uint32_t>& changed)
+{
+    while (mResidentBytes + bytes > mBudgetBytes)
+    {
+        // The least recently used texture holding a level finer than it needs.
+        uint32_t victim = InvalidId;
+        for (uint32_t id = 0; id < (uint32_t)mTextures.size(); ++id)
+        {
+            const auto& texture = mTextures[id];
+            if (id == requester || texture.ResidentMip == NoMip || texture.LoadingMip != NoMip ||
+                texture.ResidentMip >= texture.WantedMip || !CanChangeClamp(texture, completedFrameFence))
+                continue;
+            if (victim == InvalidId || texture.LastUsedFrame < mTextures[victim].LastUsedFrame)
+                victim = id;
+        }
+        if (victim == InvalidId)
+            return false;
+
+        // The frame being recorded already samples with the raised clamp, and
+        // the direct queue unmaps the level after every frame that used it.
+        auto& texture = mTextures[victim];
+        const UINT mip = texture.ResidentMip;
+        Publish(victim, mip + 1, nextFrameFence, changed);
+        UpdateMapping(mDirectQueue, texture.Resource.Get(), mip,
+            (UINT)(texture.MipBytes[mip] / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES), nullptr);
+        mPendingReleases.push_back({ nextFrameFence, std::move(texture.MipHeaps[mip]) });
+        mResidentBytes -= texture.MipBytes[mip];
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct DecodedTexture;
+class UploadManager;
+
+// Streams the mip levels of 2D textures in and out of video memory.
+//
+// Streamed textures are reserved (tiled) resources. The packed mip tail, or
+// the coarsest level if there is none, stays resident; every finer level is
+// mapped to its own heap while it is resident. Users report the finest mip
+// they need each frame (Request), Update loads missing levels coarsest first
+// through the UploadManager and, when the budget is exceeded, evicts levels
+// that are no longer needed, least recently used texture first.
+//
+// Views of a streamed texture must clamp with ResourceMinLODClamp at
+// ResidentMip(), since the unmapped levels must not be sampled. The clamp
+// changes at most once per completed frame, so two descriptors per texture,
+// alternated by SrvSlot(), are never rewritten while the GPU may read them.
+class TextureStreamer
+{
+public:
+    static constexpr uint32_t InvalidId = ~0u;
+
+    // Needs tiled resources (tier 1).
+    static bool IsSupported(ID3D12Device* device);
+
+    // Tile mappings that drop levels go to directQueue, ahead of the frame
+    // that stops sampling them.
+    TextureStreamer(ID3D12Device* device, ID3D12CommandQueue* directQueue, UploadManager* uploader,
+        UINT64 budgetBytes, UINT64 uploadBytesPerUpdate);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer& rhs) = delete;
+    TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+
+    // Takes over a decoded texture and its CPU copy of all levels, which the
+    // streamer keeps to load levels from. The texture is usable once Update
+    // reports it for the first time.
+    uint32_t Add(DecodedTexture&& texture);
+
+    // Mip level at which the texture's texels match the screen's pixels, for
+    // a surface with worldUnitsPerUV world units per texture coordinate unit
+    // seen at pixelsPerWorldUnit.
+    float RequiredMip(uint32_t id, float worldUnitsPerUV, float pixelsPerWorldUnit) const;
+
+    // Asks for mip and finer-than-mip levels to be resident. Called every
+    // frame for every visible use; the finest request of the frame wins.
+    void Request(uint32_t id, float mip);
+
+    // nextFrameFence is the value the direct queue signals after the frame
+    // being recorded, completedFrameFence the last one it reached. Appends the
+    // textures whose clamp (and SrvSlot) changed; their views have to be
+    // rewritten before the frame is recorded.
+    void Update(UINT64 nextFrameFence, UINT64 completedFrameFence, std::vector<uint32_t>& changed);
+
+    ID3D12Resource* Resource(uint32_t id) const;
+    UINT ResidentMip(uint32_t id) const;
+    UINT SrvSlot(uint32_t id) const;
+
+    struct Stats
+    {
+        UINT64 BudgetBytes = 0;
+        UINT64 ResidentBytes = 0;
+        UINT TextureCount = 0;
+        UINT LoadingCount = 0;
+    };
+    Stats GetStats() const;
+
+private:
+    static constexpr UINT NoMip = ~0u;
+
+    struct StreamedTexture
+    {
+        std::unique_ptr<DecodedTexture> Source;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        UINT Size = 0;
+        UINT MipLevels = 0;
+        // First level that is always resident; levels below it are streamed.
+        UINT PinnedMip = 0;
+
+        // Heaps of the streamed levels (null while unmapped) and of the
+        // pinned levels.
+        std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> MipHeaps;
+        std::vector<UINT64> MipBytes;
+        Microsoft::WRL::ComPtr<ID3D12Heap> PinnedHeap;
+        UINT64 PinnedBytes = 0;
+
+        // Published clamp; NoMip until the pinned levels are uploaded.
+        UINT ResidentMip = NoMip;
+        UINT SrvSlot = 1;
+        UINT64 ClampFence = 0;
+
+        // Level being uploaded (or uploaded and waiting to be published).
+        UINT LoadingMip = NoMip;
+        UINT64 LoadFence = 0;
+
+        UINT WantedMip = 0;
+        UINT64 LastUsedFrame = 0;
+    };
+
+    struct PendingRelease
+    {
+        UINT64 Fence;
+        Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+    };
+
+    Microsoft::WRL::ComPtr<ID3D12Heap> CreateTileHeap(UINT64 tileCount);
+    void Map(ID3D12CommandQueue* queue, StreamedTexture& texture, UINT mip, UINT tileCount, ID3D12Heap* heap);
+    bool CanChangeClamp(const StreamedTexture& texture, UINT64 completedFrameFence) const;
+    void Publish(uint32_t id, UINT mip, UINT64 nextFrameFence, std::vector<uint32_t>& changed);
+    // Evicts unneeded levels of other textures until bytes more fit the budget.
+    bool MakeRoom(UINT64 bytes, uint32_t requester, UINT64 nextFrameFence, UINT64 completedFrameFence,
+        std::vector<uint32_t>& changed);
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    ID3D12CommandQueue* mDirectQueue = nullptr;
+    UploadManager* mUploader = nullptr;
+    const UINT64 mBudgetBytes;
+    const UINT64 mUploadBytesPerUpdate;
+
+    std::vector<StreamedTexture> mTextures;
+    std::deque<PendingRelease> mPendingReleases;
+    UINT64 mResidentBytes = 0;
+    UINT64 mFrame = 0;
+};
@@ -0,0 +1,285 @@
+#include "TlsfAllocator.h"
+#include <bit>
+#include <cassert>
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size, uint64_t granularity)
+    : mGranularity(granularity)
+{
+    assert(std::has_single_bit(granularity));
+    mGranularityShift = (uint32_t)std::countr_zero(granularity);
+    mSize = size & ~(granularity - 1);
+
+    for (auto& lists : mFreeLists)
+        lists.fill(Null);
+
+    if (mSize > 0)
+    {
+        uint32_t block = NewBlock();
+        mBlocks[block].Offset = 0;
+        mBlocks[block].Size = mSize;
+        InsertFree(block);
+    }
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+    if (alignment < mGranularity)
+        alignment = mGranularity;
+    assert(std::has_single_bit(alignment));
+
+    size = AlignUp(size == 0 ? 1 : size, mGranularity);
+    // Worst case padding in front of an aligned offset.
+    uint64_t needed = size + (alignment - mGranularity);
+    if (size > mSize || needed > mSize)
+        return {};
+
+    uint32_t index = FindFree(needed);
+    if (index == Null)
+        return {};
+
+    RemoveFree(index);
+
+    uint64_t offset = AlignUp(mBlocks[index].Offset, alignment);
+    uint64_t padding = offset - mBlocks[index].Offset;
+    if (padding > 0)
+    {
+        // Give the padding back as a free block of its own.
+        uint32_t aligned = Split(index, padding);
+        InsertFree(index);
+        index = aligned;
+    }
+
+    if (mBlocks[index].Size > size)
+        InsertFree(Split(index, size));
+
+    mUsedSize += size;
+    mAllocationCount++;
+
+    Allocation allocation;
+    allocation.Offset = mBlocks[index].Offset;
+    allocation.Size = size;
+    allocation.Handle = index;
+    return allocation;
+}
+
+void TlsfAllocator::Free(uint32_t handle)
+{
+    if (handle == InvalidHandle)
+        return;
+
+    assert(handle < mBlocks.size() && !mBlocks[handle].Free);
+    mUsedSize -= mBlocks[handle].Size;
+    mAllocationCount--;
+
+    uint32_t index = handle;
+    uint32_t prev = mBlocks[index].PrevPhysical;
+    if (prev != Null && mBlocks[prev].Free)
+    {
+        RemoveFree(prev);
+        Merge(prev, index);
+        index = prev;
+    }
+
+    uint32_t next = mBlocks[index].NextPhysical;
+    if (next != Null && mBlocks[next].Free)
+    {
+        RemoveFree(next);
+        Merge(index, next);
+    }
+
+    InsertFree(index);
+}
+
+uint64_t TlsfAllocator::Size() const
+{
+    return mSize;
+}
+
+uint64_t TlsfAllocator::Granularity() const
+{
+    return mGranularity;
+}
+
+bool TlsfAllocator::Empty() const
+{
+    return mAllocationCount == 0;
+}
+
+TlsfAllocator::Stats TlsfAllocator::GetStats() const
+{
+    Stats stats;
+    stats.TotalSize = mSize;
+    stats.UsedSize = mUsedSize;
+    stats.FreeSize = mSize - mUsedSize;
+    stats.AllocationCount = mAllocationCount;
+
+    // Only the non-empty bins are walked.
+    for (uint64_t flMap = mFirstLevelBitmap; flMap != 0; flMap &= flMap - 1)
+    {
+        uint32_t fl = (uint32_t)std::countr_zero(flMap);
+        for (uint32_t slMap = mSecondLevelBitmaps[fl]; slMap != 0; slMap &= slMap - 1)
+        {
+            uint32_t sl = (uint32_t)std::countr_zero(slMap);
+            for (uint32_t i = mFreeLists[fl][sl]; i != Null; i = mBlocks[i].NextFree)
+            {
+                stats.FreeBlockCount++;
+                if (mBlocks[i].Size > stats.LargestFreeBlock)
+                    stats.LargestFreeBlock = mBlocks[i].Size;
+            }
+        }
+    }
+    return stats;
+}
+
+void TlsfAllocator::Mapping(uint64_t units, uint32_t& fl, uint32_t& sl)
+{
+    if (units < SecondLevelCount)
+    {
+        fl = 0;
+        sl = (uint32_t)units;
+        return;
+    }
+
+    uint32_t topBit = (uint32_t)std::bit_width(units) - 1;
+    fl = topBit - SecondLevelBits + 1;
+    sl = (uint32_t)(units >> (topBit - SecondLevelBits)) ^ SecondLevelCount;
+}
+
+uint32_t TlsfAllocator::NewBlock()
+{
+    if (!mUnusedBlocks.empty())
+    {
+        uint32_t index = mUnusedBlocks.back();
+        mUnusedBlocks.pop_back();
+        mBlocks[index] = Block();
+        return index;
+    }
+
+    mBlocks.emplace_back();
+    return (uint32_t)mBlocks.size() - 1;
+}
+
+void TlsfAllocator::ReleaseBlock(uint32_t index)
+{
+    mBlocks[index] = Block();
+    mUnusedBlocks.push_back(index);
+}
+
+void TlsfAllocator::InsertFree(uint32_t index)
+{
+    uint32_t fl, sl;
+    Mapping(mBlocks[index].Size >> mGranularityShift, fl, sl);
+
+    Block& block = mBlocks[index];
+    uint32_t head = mFreeLists[fl][sl];
+    block.Free = true;
+    block.PrevFree = Null;
+    block.NextFree = head;
+    if (head != Null)
+        mBlocks[head].PrevFree = index;
+    mFreeLists[fl][sl] = index;
+
+    mFirstLevelBitmap |= uint64_t(1) << fl;
+    mSecondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t index)
+{
+    uint32_t fl, sl;
+    Mapping(mBlocks[index].Size >> mGranularityShift, fl, sl);
+
+    Block& block = mBlocks[index];
+    if (block.PrevFree != Null)
+        mBlocks[block.PrevFree].NextFree = block.NextFree;
+    else
+        mFreeLists[fl][sl] = block.NextFree;
+    if (block.NextFree != Null)
+        mBlocks[block.NextFree].PrevFree = block.PrevFree;
+
+    block.Free = false;
+    block.PrevFree = Null;
+    block.NextFree = Null;
+
+    if (mFreeLists[fl][sl] == Null)
+    {
+        mSecondLevelBitmaps[fl] &= ~(1u << sl);
+        if (mSecondLevelBitmaps[fl] == 0)
+            mFirstLevelBitmap &= ~(uint64_t(1) << fl);
+    }
+}
+
+uint32_t TlsfAllocator::FindFree(uint64_t size) const
+{
+    uint64_t units = size >> mGranularityShift;
+
+    // Round the request up to the next bin so that any block found there is
+    // large enough without looking at its size.
+    uint64_t rounded = units;
+    if (rounded >= SecondLevelCount)
+        rounded += (uint64_t(1) << (std::bit_width(rounded) - 1 - SecondLevelBits)) - 1;
+
+    uint32_t fl, sl;
+    Mapping(rounded, fl, sl);
+    if (fl < FirstLevelCount)
+    {
+        uint32_t slMap = mSecondLevelBitmaps[fl] & (~0u << sl);
+        if (slMap == 0)
+        {
+            uint64_t flMap = (fl + 1 < 64) ? mFirstLevelBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+            if (flMap != 0)
+            {
+                fl = (uint32_t)std::countr_zero(flMap);
+                slMap = mSecondLevelBitmaps[fl];
+            }
+        }
+        if (slMap != 0)
+            return mFreeLists[fl][std::countr_zero(slMap)];
+    }
+
+    // The bin of the request itself may still hold a block that fits, e.g.
+    // when asking for the whole range.
+    Mapping(units, fl, sl);
+    for (uint32_t i = mFreeLists[fl][sl]; i != Null; i = mBlocks[i].NextFree)
+    {
+        if (mBlocks[i].Size >= size)
+            return i;
+    }
+    return Null;
+}
+
+uint32_t TlsfAllocator::Split(uint32_t index, uint64_t size)
+{
+    uint32_t rest = NewBlock();
+
+    Block& block = mBlocks[index];
+    Block& remainder = mBlocks[rest];
+    remainder.Offset = block.Offset + size;
+    remainder.Size = block.Size - size;
+    remainder.PrevPhysical = index;
+    remainder.NextPhysical = block.NextPhysical;
+    if (block.NextPhysical != Null)
+        mBlocks[block.NextPhysical].PrevPhysical = rest;
+
+    block.Size = size;
+    block.NextPhysical = rest;
+    return rest;
+}
+
+void TlsfAllocator::Merge(uint32_t first, uint32_t second)
+{
+    Block& block = mBlocks[first];
+    block.Size += mBlocks[second].Size;
+    block.NextPhysical = mBlocks[second].NextPhysical;
+    if (block.NextPhysical != Null)
+        mBlocks[block.NextPhysical].PrevPhysical = first;
+
+    ReleaseBlock(second);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Two level segregated fit allocator over an abstract range [0, size). It
+// only hands out offsets, so it can manage GPU heaps, buffer ranges or
+// anything else, and it has no dependency on D3D12.
+//
+// Free blocks are binned by size: the first level is the power of two, the
+// second level splits every power of two into 16 linear classes. Two bitmaps
+// record the non-empty bins, so finding a block and freeing one (merging
+// with its physical neighbours) are O(1).
+class TlsfAllocator
+{
+public:
+    static constexpr uint32_t InvalidHandle = ~0u;
+
+    struct Allocation
+    {
+        uint64_t Offset = 0;
+        uint64_t Size = 0;
+        uint32_t Handle = InvalidHandle;
+
+        bool IsValid() const { return Handle != InvalidHandle; }
+    };
+
+    struct Stats
+    {
+        uint64_t TotalSize = 0;
+        uint64_t UsedSize = 0;
+        uint64_t FreeSize = 0;
+        uint64_t LargestFreeBlock = 0;
+        uint32_t AllocationCount = 0;
+        uint32_t FreeBlockCount = 0;
+
+        // 0 when all free space is one block, approaching 1 as it splinters.
+        double Fragmentation() const
+        {
+            return FreeSize == 0 ? 0.0 : 1.0 - (double)LargestFreeBlock / (double)FreeSize;
+        }
+    };
+
+    // granularity must be a power of two; every size and offset is a multiple of it.
+    TlsfAllocator(uint64_t size, uint64_t granularity);
+
+    // Returns an invalid allocation when no free block is large enough.
+    // alignment must be a power of two (0 means granularity).
+    Allocation Allocate(uint64_t size, uint64_t alignment = 0);
+    void Free(uint32_t handle);
+
+    uint64_t Size() const;
+    uint64_t Granularity() const;
+    bool Empty() const;
+    Stats GetStats() const;
+
+private:
+    static constexpr uint32_t SecondLevelBits = 4;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+    static constexpr uint32_t FirstLevelCount = 64 - SecondLevelBits + 1;
+    static constexpr uint32_t Null = ~0u;
+
+    struct Block
+    {
+        uint64_t Offset = 0;
+        uint64_t Size = 0;
+        uint32_t PrevPhysical = Null;
+        uint32_t NextPhysical = Null;
+        uint32_t PrevFree = Null;
+        uint32_t NextFree = Null;
+        bool Free = false;
+    };
+
+    static void Mapping(uint64_t units, uint32_t& fl, uint32_t& sl);
+
+    uint32_t NewBlock();
+    void ReleaseBlock(uint32_t index);
+    void InsertFree(uint32_t index);
+    void RemoveFree(uint32_t index);
+    uint32_t FindFree(uint64_t size) const;
+    // Splits size bytes off the front of a block; returns the remainder (or Null).
+    uint32_t Split(uint32_t index, uint64_t size);
+    void Merge(uint32_t first, uint32_t second);
+
+private:
+    uint64_t mSize = 0;
+    uint64_t mGranularity = 1;
+    uint32_t mGranularityShift = 0;
+
+    uint64_t mUsedSize = 0;
+    uint32_t mAllocationCount = 0;
+
+    uint64_t mFirstLevelBitmap = 0;
+    std::array<uint32_t, FirstLevelCount> mSecondLevelBitmaps = {};
+    std::array<std::array<uint32_t, SecondLevelCount>, FirstLevelCount> mFreeLists;
+
+    std::vector<Block> mBlocks;
+    std::vector<uint32_t> mUnusedBlocks;
+};
@@ -0,0 +1,178 @@
+#include "UploadManager.h"
+#include "directx/d3dx12.h"
+#include "GraphicsUtil.h"
+
+using Microsoft::WRL::ComPtr;
+
+UploadManager::UploadManager(ID3D12Device* device, GpuHeapAllocator* allocator, UINT64 stagingCapacity)
+    : md3dDevice(device), mAllocator(allocator)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+    mCopyQueue->SetName(L"Upload copy queue");
+
+    ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    mStaging = std::make_unique<LinearUploadAllocator>(device, stagingCapacity);
+}
+
+UploadManager::~UploadManager()
+{
+    // Staging memory and destinations must outlive the copies in flight.
+    WaitIdle();
+}
+
+GpuResource UploadManager::CreateBuffer(const void* data, UINT64 byteSize)
+{
+    GpuResource buffer = mAllocator->CreateBuffer(byteSize, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+    UploadToBuffer(buffer.Get(), 0, data, byteSize);
+    return buffer;
+}
+
+void UploadManager::UploadToBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    ID3D12GraphicsCommandList* cmdList = BeginRecording();
+    UploadAllocation staging = mStaging->Allocate(byteSize, D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+    Buffers::StreamingCopy(staging.CPU, (size_t)byteSize, data, (size_t)byteSize);
+
+    cmdList->CopyBufferRegion(dest, destOffset, staging.Resource, staging.Offset, byteSize);
+}
+
+void UploadManager::UploadToTexture(ID3D12Resource* dest, UINT firstSubresource,
+    std::span<const D3D12_SUBRESOURCE_DATA> subresources)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    const UINT count = (UINT)subresources.size();
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(count);
+    std::vector<UINT> numRows(count);
+    std::vector<UINT64> rowSizes(count);
+    UINT64 totalBytes = 0;
+
+    auto desc = dest->GetDesc();
+    md3dDevice->GetCopyableFootprints(&desc, firstSubresource, count, 0,
+        layouts.data(), numRows.data(), rowSizes.data(), &totalBytes);
+
+    ID3D12GraphicsCommandList* cmdList = BeginRecording();
+    UploadAllocation staging = mStaging->Allocate(totalBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+    for (UINT i = 0; i < count; ++i)
+    {
+        const auto& footprint = layouts[i].Footprint;
+        const auto& source = subresources[i];
+        BYTE* destSlice = staging.CPU + layouts[i].Offset;
+        const UINT64 destSlicePitch = (UINT64)footprint.RowPitch * numRows[i];
+
+        for (UINT z = 0; z < footprint.Depth; ++z)
+        {
+            for (UINT row = 0; row < numRows[i]; ++row)
+            {
+                BYTE* destRow = destSlice + destSlicePitch * z + (UINT64)footprint.RowPitch * row;
+                auto sourceRow = static_cast<const BYTE*>(source.pData) + source.SlicePitch * z + source.RowPitch * row;
+                Buffers::StreamingCopy(destRow, (size_t)rowSizes[i], sourceRow, (size_t)rowSizes[i]);
+            }
+        }
+
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT placed = layouts[i];
+        placed.Offset += staging.Offset;
+        CD3DX12_TEXTURE_COPY_LOCATION dst(dest, firstSubresource + i);
+        CD3DX12_TEXTURE_COPY_LOCATION src(staging.Resource, placed);
+        cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    }
+}
+
+UINT64 UploadManager::Submit()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mRecording)
+        return mLastSubmittedFence;
+
+    Buffers::StreamingFence();
+    ThrowIfFailed(mCommandList->Close());
+    ID3D12CommandList* cmdLists[] = { mCommandList.Get() };
+    mCopyQueue->ExecuteCommandLists(1, cmdLists);
+
+    mLastSubmittedFence++;
+    ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), mLastSubmittedFence));
+
+    mStaging->FinishFrame(mLastSubmittedFence);
+    mPendingAllocators.push_back({ mLastSubmittedFence, mCurrentAllocator });
+    mCurrentAllocator = nullptr;
+    mRecording = false;
+
+    return mLastSubmittedFence;
+}
+
+void UploadManager::WaitOnQueue(ID3D12CommandQueue* queue, UINT64 fenceValue)
+{
+    if (fenceValue == 0)
+        fenceValue = mLastSubmittedFence;
+    if (fenceValue != 0 && !IsComplete(fenceValue))
+        ThrowIfFailed(queue->Wait(mFence.Get(), fenceValue));
+}
+
+void UploadManager::WaitIdle()
+{
+    mEventPool.Wait(mFence.Get(), mLastSubmittedFence);
+    Retire();
+}
+
+bool UploadManager::IsComplete(UINT64 fenceValue) const
+{
+    return mFence->GetCompletedValue() >= fenceValue;
+}
+
+void UploadManager::Retire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT64 completed = mFence->GetCompletedValue();
+    mStaging->Retire(completed);
+
+    while (!mPendingAllocators.empty() && mPendingAllocators.front().Fence <= completed)
+    {
+        mFreeAllocators.push_back(mPendingAllocators.front().Allocator);
+        mPendingAllocators.pop_front();
+    }
+}
+
+ID3D12CommandQueue* UploadManager::Queue() const
+{
+    return mCopyQueue.Get();
+}
+
+ID3D12GraphicsCommandList* UploadManager::BeginRecording()
+{
+    if (mRecording)
+        return mCommandList.Get();
+
+    if (!mFreeAllocators.empty())
+    {
+        mCurrentAllocator = mFreeAllocators.back();
+        mFreeAllocators.pop_back();
+        ThrowIfFailed(mCurrentAllocator->Reset());
+    }
+    else
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+            IID_PPV_ARGS(mCurrentAllocator.GetAddressOf())));
+    }
+
+    if (mCommandList == nullptr)
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+            mCurrentAllocator.Get(), nullptr, IID_PPV_ARGS(mCommandList.GetAddressOf())));
+    }
+    else
+    {
+        ThrowIfFailed(mCommandList->Reset(mCurrentAllocator.Get(), nullptr));
+    }
+
+    mRecording = true;
+    return mCommandList.Get();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <wrl.h>
+#include "directx/d3d12.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "Buffers.h"
+#include "FramePacer.h"
+#include "GpuHeapAllocator.h"
+
+// Records resource uploads into a batch and runs them on a dedicated copy
+// queue. Source data is copied into a staging ring (LinearUploadAllocator)
+// when the upload is queued, so callers can free their memory right away;
+// staging space and command allocators are recycled once the copy queue's
+// fence shows the batch is done.
+//
+// No barriers are recorded. Destinations start in COMMON (or COPY_DEST) and
+// everything touched on a copy queue decays to COMMON when the batch
+// completes, so buffers and textures are implicitly promoted to their read
+// state on first use on the direct queue. The direct queue only has to
+// WaitOnQueue for the batch before using the resources.
+class UploadManager
+{
+public:
+    UploadManager(ID3D12Device* device, GpuHeapAllocator* allocator, UINT64 stagingCapacity);
+    ~UploadManager();
+
+    UploadManager(const UploadManager& rhs) = delete;
+    UploadManager& operator=(const UploadManager& rhs) = delete;
+
+    // Creates a default heap buffer in the COMMON state and queues its contents.
+    GpuResource CreateBuffer(const void* data, UINT64 byteSize);
+    void UploadToBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize);
+    void UploadToTexture(ID3D12Resource* dest, UINT firstSubresource,
+        std::span<const D3D12_SUBRESOURCE_DATA> subresources);
+
+    // Executes everything queued since the last call. Returns the fence value
+    // that marks the batch as complete (the previous one if nothing was queued).
+    UINT64 Submit();
+
+    // Makes queue wait on the GPU for the given batch (default: the last one).
+    void WaitOnQueue(ID3D12CommandQueue* queue, UINT64 fenceValue = 0);
+    // Blocks the CPU until everything submitted has been copied.
+    void WaitIdle();
+    bool IsComplete(UINT64 fenceValue) const;
+
+    // Recycles staging memory and allocators of completed batches.
+    void Retire();
+
+    ID3D12CommandQueue* Queue() const;
+
+private:
+    ID3D12GraphicsCommandList* BeginRecording();
+
+private:
+    struct PendingAllocator
+    {
+        UINT64 Fence;
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+    };
+
+    ID3D12Device* md3dDevice = nullptr;
+    GpuHeapAllocator* mAllocator = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCurrentAllocator;
+    std::deque<PendingAllocator> mPendingAllocators;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> mFreeAllocators;
+
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    UINT64 mLastSubmittedFence = 0;
+    FenceEventPool mEventPool;
+
+    std::unique_ptr<LinearUploadAllocator> mStaging;
+    bool mRecording = false;
+
+    // Uploads may be queued from loader threads.
+    mutable std::mutex mMutex;
+};
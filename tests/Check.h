@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Minimal checks for the headless tests: a failed CHECK is reported and
+// counted, and the test's main returns TestResult().
+inline int gCheckFailures = 0;
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++gCheckFailures;                                                   \
+        }                                                                       \
+    } while (0)
+
+inline int TestResult()
+{
+    if (gCheckFailures == 0)
+        std::printf("All checks passed\n");
+    return gCheckFailures == 0 ? 0 : 1;
+}
+
+inline std::vector<uint8_t> ReadBytes(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+inline void WriteBytes(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+}
+
+// A scratch directory next to the test binary, emptied on construction.
+// The suffix keeps it from replacing a binary of the same name.
+inline std::filesystem::path ScratchDirectory(const char* name)
+{
+    const std::filesystem::path directory = std::filesystem::current_path() / (std::string(name) + ".scratch");
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    return directory;
+}
@@ -0,0 +1,271 @@
+#include "Check.h"
+#include "PipelineCacheFile.h"
+
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+namespace
+{
+    const uint8_t VertexShader[] = { 0x44, 0x58, 0x42, 0x43, 1, 2, 3, 4 };
+    const uint8_t PixelShader[] = { 0x44, 0x58, 0x42, 0x43, 5, 6, 7, 8, 9 };
+    const uint8_t RootSignature[] = { 0x44, 0x58, 0x42, 0x43, 0x10, 0x20, 0x30 };
+
+    const D3D12_INPUT_ELEMENT_DESC InputLayout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+
+    // A typical opaque pass. fill is written over the whole description
+    // first, so two descriptions only agree on the fields that are set.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC MakeGraphicsDesc(uint8_t fill)
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+        std::memset(&desc, fill, sizeof(desc));
+
+        desc.pRootSignature = nullptr;
+        desc.VS = { VertexShader, sizeof(VertexShader) };
+        desc.PS = { PixelShader, sizeof(PixelShader) };
+        desc.DS = {};
+        desc.HS = {};
+        desc.GS = {};
+        desc.StreamOutput = {};
+
+        desc.BlendState.AlphaToCoverageEnable = FALSE;
+        desc.BlendState.IndependentBlendEnable = FALSE;
+        for (auto& target : desc.BlendState.RenderTarget)
+        {
+            target.BlendEnable = FALSE;
+            target.LogicOpEnable = FALSE;
+            target.SrcBlend = D3D12_BLEND_ONE;
+            target.DestBlend = D3D12_BLEND_ZERO;
+            target.BlendOp = D3D12_BLEND_OP_ADD;
+            target.SrcBlendAlpha = D3D12_BLEND_ONE;
+            target.DestBlendAlpha = D3D12_BLEND_ZERO;
+            target.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+            target.LogicOp = D3D12_LOGIC_OP_NOOP;
+            target.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+        }
+        desc.SampleMask = UINT_MAX;
+
+        desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+        desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+        desc.RasterizerState.FrontCounterClockwise = FALSE;
+        desc.RasterizerState.DepthBias = 0;
+        desc.RasterizerState.DepthBiasClamp = 0.0f;
+        desc.RasterizerState.SlopeScaledDepthBias = 0.0f;
+        desc.RasterizerState.DepthClipEnable = TRUE;
+        desc.RasterizerState.MultisampleEnable = FALSE;
+        desc.RasterizerState.AntialiasedLineEnable = FALSE;
+        desc.RasterizerState.ForcedSampleCount = 0;
+        desc.RasterizerState.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+        const D3D12_DEPTH_STENCILOP_DESC stencilOp =
+            { D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_KEEP, D3D12_COMPARISON_FUNC_ALWAYS };
+        desc.DepthStencilState.DepthEnable = TRUE;
+        desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+        desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+        desc.DepthStencilState.StencilEnable = FALSE;
+        desc.DepthStencilState.StencilReadMask = 0xff;
+        desc.DepthStencilState.StencilWriteMask = 0xff;
+        desc.DepthStencilState.FrontFace = stencilOp;
+        desc.DepthStencilState.BackFace = stencilOp;
+
+        desc.InputLayout = { InputLayout, (UINT)std::size(InputLayout) };
+        desc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
+        desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+        desc.NumRenderTargets = 1;
+        for (auto& format : desc.RTVFormats)
+            format = DXGI_FORMAT_UNKNOWN;
+        desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+        desc.SampleDesc = { 1, 0 };
+        desc.NodeMask = 0;
+        desc.CachedPSO = {};
+        desc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+        return desc;
+    }
+
+    uint64_t Key(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        return PipelineCacheFile::Key(desc, RootSignature);
+    }
+
+    void TestKeyStability()
+    {
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = MakeGraphicsDesc(0x00);
+        CHECK(Key(desc) == Key(desc));
+
+        // Padding and the pointers that aren't part of the pipeline are
+        // left out of the key.
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC other = MakeGraphicsDesc(0xcd);
+        other.pRootSignature = reinterpret_cast<ID3D12RootSignature*>(0x1000);
+        other.CachedPSO = { PixelShader, sizeof(PixelShader) };
+        CHECK(Key(other) == Key(desc));
+
+        // Equal contents at other addresses.
+        std::vector<uint8_t> vertexShader(std::begin(VertexShader), std::end(VertexShader));
+        std::vector<D3D12_INPUT_ELEMENT_DESC> layout(std::begin(InputLayout), std::end(InputLayout));
+        const std::string position = "POSITION";
+        layout[0].SemanticName = position.c_str();
+        other.VS = { vertexShader.data(), vertexShader.size() };
+        other.InputLayout = { layout.data(), (UINT)layout.size() };
+        std::vector<uint8_t> rootSignature(std::begin(RootSignature), std::end(RootSignature));
+        CHECK(PipelineCacheFile::Key(other, rootSignature) == Key(desc));
+
+        CHECK(PipelineCacheFile::Name(Key(desc)) == PipelineCacheFile::Name(Key(other)));
+        CHECK(PipelineCacheFile::Name(Key(desc)).size() == 16);
+    }
+
+    void TestKeyChanges()
+    {
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC base = MakeGraphicsDesc(0x00);
+        const uint64_t baseKey = Key(base);
+
+        auto changes = [&](auto change)
+        {
+            D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = base;
+            change(desc);
+            return Key(desc) != baseKey;
+        };
+
+        // States.
+        CHECK(changes([](auto& d) { d.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME; }));
+        CHECK(changes([](auto& d) { d.RasterizerState.CullMode = D3D12_CULL_MODE_NONE; }));
+        CHECK(changes([](auto& d) { d.RasterizerState.DepthBias = 1; }));
+        CHECK(changes([](auto& d) { d.RasterizerState.SlopeScaledDepthBias = 1.0f; }));
+        CHECK(changes([](auto& d) { d.BlendState.RenderTarget[0].BlendEnable = TRUE; }));
+        CHECK(changes([](auto& d) { d.BlendState.RenderTarget[7].RenderTargetWriteMask = 0; }));
+        CHECK(changes([](auto& d) { d.BlendState.AlphaToCoverageEnable = TRUE; }));
+        CHECK(changes([](auto& d) { d.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL; }));
+        CHECK(changes([](auto& d) { d.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO; }));
+        CHECK(changes([](auto& d) { d.DepthStencilState.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_EQUAL; }));
+        CHECK(changes([](auto& d) { d.SampleMask = 1; }));
+        CHECK(changes([](auto& d) { d.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE; }));
+
+        // Formats.
+        CHECK(changes([](auto& d) { d.RTVFormats[0] = DXGI_FORMAT_R16G16B16A16_FLOAT; }));
+        CHECK(changes([](auto& d) { d.RTVFormats[1] = DXGI_FORMAT_R8G8B8A8_UNORM; }));
+        CHECK(changes([](auto& d) { d.NumRenderTargets = 2; }));
+        CHECK(changes([](auto& d) { d.DSVFormat = DXGI_FORMAT_D32_FLOAT; }));
+        CHECK(changes([](auto& d) { d.SampleDesc.Count = 4; }));
+
+        // Input elements.
+        auto changesElement = [&](auto change)
+        {
+            std::vector<D3D12_INPUT_ELEMENT_DESC> layout(std::begin(InputLayout), std::end(InputLayout));
+            change(layout);
+            return changes([&](auto& d) { d.InputLayout = { layout.data(), (UINT)layout.size() }; });
+        };
+        CHECK(changesElement([](auto& l) { l[1].SemanticName = "TANGENT"; }));
+        CHECK(changesElement([](auto& l) { l[2].SemanticIndex = 1; }));
+        CHECK(changesElement([](auto& l) { l[0].Format = DXGI_FORMAT_R32G32B32A32_FLOAT; }));
+        CHECK(changesElement([](auto& l) { l[1].AlignedByteOffset = 16; }));
+        CHECK(changesElement([](auto& l) { l[2].InputSlot = 1; }));
+        CHECK(changesElement([](auto& l) { l[2].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA; }));
+        CHECK(changesElement([](auto& l) { l.pop_back(); }));
+
+        // Shaders.
+        CHECK(changes([](auto& d) { d.VS.BytecodeLength -= 1; }));
+        CHECK(changes([](auto& d) { d.PS = {}; }));
+
+        // Every byte of the root signature.
+        for (size_t i = 0; i < sizeof(RootSignature); ++i)
+        {
+            std::vector<uint8_t> rootSignature(std::begin(RootSignature), std::end(RootSignature));
+            rootSignature[i] ^= 0x01;
+            CHECK(PipelineCacheFile::Key(base, rootSignature) != baseKey);
+        }
+        CHECK(PipelineCacheFile::Key(base, std::span<const uint8_t>(RootSignature, sizeof(RootSignature) - 1)) != baseKey);
+
+        // Compute pipelines with the same bytecode don't share keys with
+        // graphics pipelines or with each other's root signatures.
+        D3D12_COMPUTE_PIPELINE_STATE_DESC compute = {};
+        compute.CS = { VertexShader, sizeof(VertexShader) };
+        const uint64_t computeKey = PipelineCacheFile::Key(compute, RootSignature);
+        CHECK(computeKey != baseKey);
+        CHECK(PipelineCacheFile::Key(compute, RootSignature) == computeKey);
+        CHECK(PipelineCacheFile::Key(compute, std::span<const uint8_t>()) != computeKey);
+        compute.CS = { PixelShader, sizeof(PixelShader) };
+        CHECK(PipelineCacheFile::Key(compute, RootSignature) != computeKey);
+    }
+
+    void TestFile(const std::filesystem::path& directory)
+    {
+        const std::wstring fileName = (directory / "Pipelines.bin").wstring();
+        std::vector<uint8_t> library;
+        CHECK(!PipelineCacheFile::Read(fileName, library));
+
+        std::vector<uint8_t> written(1000);
+        for (size_t i = 0; i < written.size(); ++i)
+            written[i] = (uint8_t)(i * 7 + 3);
+        CHECK(PipelineCacheFile::Write(fileName, written));
+        CHECK(PipelineCacheFile::Read(fileName, library));
+        CHECK(library == written);
+
+        // Writing again replaces the library.
+        written.resize(10);
+        CHECK(PipelineCacheFile::Write(fileName, written));
+        CHECK(PipelineCacheFile::Read(fileName, library));
+        CHECK(library == written);
+
+        const std::vector<uint8_t> original = ReadBytes(fileName);
+        constexpr size_t HeaderSize = 24;
+        constexpr size_t VersionOffset = 4;
+        CHECK(original.size() == HeaderSize + written.size());
+
+        auto reads = [&](const std::vector<uint8_t>& contents)
+        {
+            WriteBytes(fileName, contents);
+            std::vector<uint8_t> loaded;
+            const bool result = PipelineCacheFile::Read(fileName, loaded);
+            CHECK(result || loaded.empty());
+            return result;
+        };
+
+        CHECK(reads(original));
+
+        std::vector<uint8_t> otherVersion = original;
+        otherVersion[VersionOffset] = (uint8_t)(PipelineCacheFile::Version + 1);
+        CHECK(!reads(otherVersion));
+
+        std::vector<uint8_t> badMagic = original;
+        badMagic[0] ^= 0xff;
+        CHECK(!reads(badMagic));
+
+        CHECK(!reads(std::vector<uint8_t>(original.begin(), original.end() - 1)));
+        CHECK(!reads(std::vector<uint8_t>(original.begin(), original.begin() + HeaderSize)));
+        CHECK(!reads(std::vector<uint8_t>(original.begin(), original.begin() + HeaderSize / 2)));
+        CHECK(!reads({}));
+
+        // A payload that doesn't match the hash, and a hash that doesn't
+        // match the payload.
+        for (size_t i = HeaderSize; i < original.size(); ++i)
+        {
+            std::vector<uint8_t> corrupt = original;
+            corrupt[i] ^= 0x01;
+            CHECK(!reads(corrupt));
+        }
+        std::vector<uint8_t> badHash = original;
+        badHash[HeaderSize - 1] ^= 0x80;
+        CHECK(!reads(badHash));
+
+        // An empty library is still a valid file.
+        CHECK(PipelineCacheFile::Write(fileName, std::span<const uint8_t>()));
+        library = written;
+        CHECK(PipelineCacheFile::Read(fileName, library));
+        CHECK(library.empty());
+    }
+}
+
+int main()
+{
+    const std::filesystem::path directory = ScratchDirectory("PipelineCacheFileTests");
+    TestKeyStability();
+    TestKeyChanges();
+    TestFile(directory);
+    return TestResult();
+}
@@ -0,0 +1,143 @@
+#include "Check.h"
+#include "ShaderCache.h"
+
+#include <string>
+
+namespace
+{
+    // The preprocessed source of a shader including a header.
+    std::string Preprocess(const std::string& shader, const std::string& header)
+    {
+        return "#line 1 \"common.hlsl\"\n" + header + "\n#line 2 \"shader.hlsl\"\n" + shader;
+    }
+
+    const std::string Shader = "float4 PS() : SV_Target { return gColor; }\n";
+    const std::string Header = "cbuffer cb : register(b0) { float4 gColor; };\n";
+    const std::vector<uint8_t> Bytecode = { 0x44, 0x58, 0x42, 0x43, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+    ShaderCacheKey MakeKey(const std::string& source, const std::string& defines)
+    {
+        ShaderCacheKey key;
+        key.Source = source;
+        key.Defines = defines;
+        key.EntryPoint = "PS";
+        key.Target = "ps_5_1";
+        key.Flags = 1;
+        key.CompilerVersion = 47;
+        return key;
+    }
+
+    void TestHit(const std::filesystem::path& directory)
+    {
+        const std::string source = Preprocess(Shader, Header);
+        const ShaderCacheKey key = MakeKey(source, "IBL=1\n");
+        const std::wstring entry = ShaderCache::EntryPath(directory.wstring(), key);
+        CHECK(ShaderCache::Store(entry, key, Bytecode));
+
+        // A key built from equal but separately owned strings finds it too.
+        const std::string sourceCopy = Preprocess(Shader, Header);
+        const ShaderCacheKey sameKey = MakeKey(sourceCopy, std::string("IBL=1\n"));
+        CHECK(ShaderCache::EntryPath(directory.wstring(), sameKey) == entry);
+
+        std::vector<uint8_t> loaded;
+        CHECK(ShaderCache::Load(entry, sameKey, loaded));
+        CHECK(loaded == Bytecode);
+    }
+
+    void TestMisses(const std::filesystem::path& directory)
+    {
+        const std::string source = Preprocess(Shader, Header);
+        const ShaderCacheKey key = MakeKey(source, "IBL=1\n");
+        const std::wstring entry = ShaderCache::EntryPath(directory.wstring(), key);
+        CHECK(ShaderCache::Store(entry, key, Bytecode));
+
+        auto misses = [&](const ShaderCacheKey& changed)
+        {
+            // Another key names another entry, and the stored entry
+            // doesn't load for it either.
+            std::vector<uint8_t> loaded;
+            return ShaderCache::EntryPath(directory.wstring(), changed) != entry &&
+                !ShaderCache::Load(entry, changed, loaded) && loaded.empty();
+        };
+
+        const std::string editedShader = Preprocess(Shader + "// edit\n", Header);
+        CHECK(misses(MakeKey(editedShader, "IBL=1\n")));
+
+        const std::string editedInclude = Preprocess(Shader, "cbuffer cb : register(b1) { float4 gColor; };\n");
+        CHECK(misses(MakeKey(editedInclude, "IBL=1\n")));
+
+        CHECK(misses(MakeKey(source, "IBL=0\n")));
+        CHECK(misses(MakeKey(source, "")));
+        CHECK(misses(MakeKey(source, "IBL=1\nWIREFRAME=1\n")));
+
+        ShaderCacheKey otherEntryPoint = key;
+        otherEntryPoint.EntryPoint = "VS";
+        CHECK(misses(otherEntryPoint));
+
+        ShaderCacheKey otherTarget = key;
+        otherTarget.Target = "ps_6_0";
+        CHECK(misses(otherTarget));
+
+        ShaderCacheKey otherFlags = key;
+        otherFlags.Flags = 2;
+        CHECK(misses(otherFlags));
+
+        ShaderCacheKey otherCompiler = key;
+        otherCompiler.CompilerVersion = 48;
+        CHECK(misses(otherCompiler));
+
+        // Fields are hashed with their lengths, so moving text from one
+        // field to the next isn't the same key.
+        const std::string shifted = source + "I";
+        CHECK(misses(MakeKey(shifted, "BL=1\n")));
+
+        std::vector<uint8_t> loaded;
+        CHECK(!ShaderCache::Load((directory / "missing.cso").wstring(), key, loaded));
+    }
+
+    void TestDamagedEntries(const std::filesystem::path& directory)
+    {
+        const std::string source = Preprocess(Shader, Header);
+        const ShaderCacheKey key = MakeKey(source, "IBL=1\n");
+        const std::wstring entry = ShaderCache::EntryPath(directory.wstring(), key);
+        CHECK(ShaderCache::Store(entry, key, Bytecode));
+        const std::vector<uint8_t> original = ReadBytes(entry);
+        CHECK(original.size() > Bytecode.size());
+
+        auto loads = [&](const std::vector<uint8_t>& contents)
+        {
+            WriteBytes(entry, contents);
+            std::vector<uint8_t> loaded;
+            return ShaderCache::Load(entry, key, loaded);
+        };
+
+        CHECK(loads(original));
+
+        // Truncated in the bytecode, in the header, and empty.
+        CHECK(!loads(std::vector<uint8_t>(original.begin(), original.end() - 1)));
+        CHECK(!loads(std::vector<uint8_t>(original.begin(), original.begin() + 8)));
+        CHECK(!loads({}));
+
+        // Trailing garbage.
+        std::vector<uint8_t> extended = original;
+        extended.push_back(0);
+        CHECK(!loads(extended));
+
+        // A flipped bit anywhere, header or bytecode.
+        for (size_t i = 0; i < original.size(); ++i)
+        {
+            std::vector<uint8_t> corrupt = original;
+            corrupt[i] ^= 0x10;
+            CHECK(!loads(corrupt));
+        }
+    }
+}
+
+int main()
+{
+    const std::filesystem::path directory = ScratchDirectory("ShaderCacheTests");
+    TestHit(directory);
+    TestMisses(directory);
+    TestDamagedEntries(directory);
+    return TestResult();
+}
@@ -0,0 +1,234 @@
+#include "Check.h"
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <random>
+
+namespace
+{
+    constexpr uint64_t KiB = 1024;
+    constexpr uint64_t MiB = 1024 * KiB;
+    constexpr uint64_t Granularity = 64 * KiB;
+
+    void TestAlignment()
+    {
+        TlsfAllocator allocator(64 * MiB, Granularity);
+
+        // Sizes are rounded up to the granularity, an empty request included.
+        TlsfAllocator::Allocation small = allocator.Allocate(1);
+        CHECK(small.IsValid());
+        CHECK(small.Size == Granularity);
+        CHECK(small.Offset % Granularity == 0);
+        TlsfAllocator::Allocation empty = allocator.Allocate(0);
+        CHECK(empty.IsValid());
+        CHECK(empty.Size == Granularity);
+        TlsfAllocator::Allocation odd = allocator.Allocate(Granularity + 1);
+        CHECK(odd.Size == 2 * Granularity);
+
+        // Larger alignments, as MSAA textures need, start past the small
+        // allocations at an aligned offset; the padding stays free.
+        const uint64_t alignments[] = { 4 * MiB, Granularity, 1 * MiB, 4 * MiB };
+        for (uint64_t alignment : alignments)
+        {
+            TlsfAllocator::Allocation allocation = allocator.Allocate(3 * Granularity, alignment);
+            CHECK(allocation.IsValid());
+            CHECK(allocation.Offset % alignment == 0);
+            CHECK(allocation.Size == 3 * Granularity);
+        }
+        const TlsfAllocator::Stats stats = allocator.GetStats();
+        CHECK(stats.AllocationCount == 7);
+        CHECK(stats.UsedSize == 4 * Granularity + 4 * 3 * Granularity);
+
+        // Alignments below the granularity mean the granularity.
+        TlsfAllocator::Allocation fine = allocator.Allocate(Granularity, 256);
+        CHECK(fine.IsValid());
+        CHECK(fine.Offset % Granularity == 0);
+    }
+
+    void TestSplitAndCoalesce()
+    {
+        TlsfAllocator allocator(16 * Granularity, Granularity);
+        CHECK(allocator.Empty());
+
+        // Allocations split the free block and are laid out back to back.
+        TlsfAllocator::Allocation a = allocator.Allocate(4 * Granularity);
+        TlsfAllocator::Allocation b = allocator.Allocate(4 * Granularity);
+        TlsfAllocator::Allocation c = allocator.Allocate(4 * Granularity);
+        CHECK(a.IsValid() && b.IsValid() && c.IsValid());
+        CHECK(a.Offset == 0);
+        CHECK(b.Offset == 4 * Granularity);
+        CHECK(c.Offset == 8 * Granularity);
+        CHECK(!allocator.Empty());
+
+        TlsfAllocator::Stats stats = allocator.GetStats();
+        CHECK(stats.FreeBlockCount == 1);
+        CHECK(stats.LargestFreeBlock == 4 * Granularity);
+
+        // A hole between two allocations is its own free block.
+        allocator.Free(b.Handle);
+        stats = allocator.GetStats();
+        CHECK(stats.FreeBlockCount == 2);
+        CHECK(stats.FreeSize == 8 * Granularity);
+
+        // Freeing its neighbours merges everything back into one block.
+        allocator.Free(a.Handle);
+        stats = allocator.GetStats();
+        CHECK(stats.FreeBlockCount == 2);
+        CHECK(stats.LargestFreeBlock == 8 * Granularity);
+
+        allocator.Free(c.Handle);
+        stats = allocator.GetStats();
+        CHECK(allocator.Empty());
+        CHECK(stats.FreeBlockCount == 1);
+        CHECK(stats.LargestFreeBlock == 16 * Granularity);
+        CHECK(stats.UsedSize == 0);
+
+        // The merged hole is reused from its start.
+        TlsfAllocator::Allocation whole = allocator.Allocate(16 * Granularity);
+        CHECK(whole.IsValid());
+        CHECK(whole.Offset == 0);
+
+        // Freeing the invalid handle does nothing.
+        allocator.Free(TlsfAllocator::InvalidHandle);
+        CHECK(allocator.GetStats().AllocationCount == 1);
+    }
+
+    void TestExhaustion()
+    {
+        TlsfAllocator allocator(8 * Granularity, Granularity);
+
+        CHECK(!allocator.Allocate(9 * Granularity).IsValid());
+        CHECK(!allocator.Allocate(~0ull - Granularity).IsValid());
+
+        std::vector<TlsfAllocator::Allocation> allocations;
+        for (int i = 0; i < 8; ++i)
+        {
+            allocations.push_back(allocator.Allocate(Granularity));
+            CHECK(allocations.back().IsValid());
+        }
+        CHECK(!allocator.Allocate(1).IsValid());
+        CHECK(allocator.GetStats().FreeSize == 0);
+        CHECK(allocator.GetStats().FreeBlockCount == 0);
+
+        // A freed range is found again, however it was split.
+        allocator.Free(allocations[5].Handle);
+        TlsfAllocator::Allocation again = allocator.Allocate(Granularity);
+        CHECK(again.IsValid());
+        CHECK(again.Offset == 5 * Granularity);
+        CHECK(!allocator.Allocate(1).IsValid());
+
+        // An alignment that needs more than the free space fails cleanly.
+        allocator.Free(again.Handle);
+        allocator.Free(allocations[6].Handle);
+        CHECK(!allocator.Allocate(2 * Granularity, 4 * Granularity).IsValid());
+        CHECK(allocator.GetStats().AllocationCount == 6);
+
+        // A range that isn't a multiple of the granularity loses the rest.
+        TlsfAllocator rounded(3 * Granularity + 100, Granularity);
+        CHECK(rounded.Size() == 3 * Granularity);
+        CHECK(rounded.Allocate(3 * Granularity).IsValid());
+        CHECK(!rounded.Allocate(1).IsValid());
+    }
+
+    void TestFragmentationStats()
+    {
+        TlsfAllocator allocator(8 * Granularity, Granularity);
+        CHECK(allocator.GetStats().Fragmentation() == 0.0);
+
+        std::vector<TlsfAllocator::Allocation> allocations;
+        for (int i = 0; i < 8; ++i)
+            allocations.push_back(allocator.Allocate(Granularity));
+        CHECK(allocator.GetStats().Fragmentation() == 0.0);
+
+        // Every other range free: half the space, in four single holes.
+        for (int i = 0; i < 8; i += 2)
+            allocator.Free(allocations[i].Handle);
+        TlsfAllocator::Stats stats = allocator.GetStats();
+        CHECK(stats.TotalSize == 8 * Granularity);
+        CHECK(stats.UsedSize == 4 * Granularity);
+        CHECK(stats.FreeSize == 4 * Granularity);
+        CHECK(stats.FreeBlockCount == 4);
+        CHECK(stats.LargestFreeBlock == Granularity);
+        CHECK(stats.AllocationCount == 4);
+        CHECK(stats.Fragmentation() == 0.75);
+
+        // Enough space in total, but no block large enough.
+        CHECK(!allocator.Allocate(2 * Granularity).IsValid());
+
+        // Joining two holes halves the worst case.
+        allocator.Free(allocations[1].Handle);
+        stats = allocator.GetStats();
+        CHECK(stats.FreeBlockCount == 3);
+        CHECK(stats.LargestFreeBlock == 3 * Granularity);
+        CHECK(stats.Fragmentation() == 1.0 - 3.0 / 5.0);
+
+        for (int i = 3; i < 8; i += 2)
+            allocator.Free(allocations[i].Handle);
+        stats = allocator.GetStats();
+        CHECK(stats.FreeBlockCount == 1);
+        CHECK(stats.Fragmentation() == 0.0);
+    }
+
+    // Random allocations and frees never overlap, the statistics match what
+    // is live, and freeing everything leaves one block.
+    void TestRandom()
+    {
+        constexpr uint64_t Size = 256 * MiB;
+        TlsfAllocator allocator(Size, Granularity);
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint64_t> sizes(1, 4 * MiB);
+        std::uniform_int_distribution<int> alignmentShift(0, 6);
+
+        std::vector<TlsfAllocator::Allocation> live;
+        for (int step = 0; step < 20000; ++step)
+        {
+            if (!live.empty() && (rng() % 2 == 0 || live.size() > 200))
+            {
+                const size_t i = rng() % live.size();
+                allocator.Free(live[i].Handle);
+                live[i] = live.back();
+                live.pop_back();
+            }
+            else
+            {
+                const uint64_t alignment = Granularity << alignmentShift(rng);
+                TlsfAllocator::Allocation allocation = allocator.Allocate(sizes(rng), alignment);
+                if (allocation.IsValid())
+                {
+                    CHECK(allocation.Offset % alignment == 0);
+                    CHECK(allocation.Offset + allocation.Size <= Size);
+                    live.push_back(allocation);
+                }
+            }
+        }
+
+        std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.Offset < b.Offset; });
+        uint64_t used = 0;
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            used += live[i].Size;
+            if (i > 0)
+                CHECK(live[i - 1].Offset + live[i - 1].Size <= live[i].Offset);
+        }
+        const TlsfAllocator::Stats stats = allocator.GetStats();
+        CHECK(stats.UsedSize == used);
+        CHECK(stats.AllocationCount == live.size());
+
+        for (auto& allocation : live)
+            allocator.Free(allocation.Handle);
+        CHECK(allocator.Empty());
+        CHECK(allocator.GetStats().FreeBlockCount == 1);
+        CHECK(allocator.GetStats().LargestFreeBlock == Size);
+    }
+}
+
+int main()
+{
+    TestAlignment();
+    TestSplitAndCoalesce();
+    TestExhaustion();
+    TestFragmentationStats();
+    TestRandom();
+    return TestResult();
+}